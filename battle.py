@@ -1,8 +1,9 @@
 #!/usr/bin/env python3
 
+import sys
 from typing import List
 
-from tensorflow.keras.models import load_model
+import numpy as np
 
 UNITS = [
     'SmallCargo',
@@ -58,7 +59,7 @@ def dump_results(results: List[float], scale: float):
         for j, kind in enumerate(UNITS):
             mean = results[i * NUM_UNITS + j]
             mean_scaled = mean / (mean_scale * scale)
-            sd = results[i * NUM_UNITS + j + NUM_UNITS]
+            sd = results[2 * NUM_UNITS + i * NUM_UNITS + j]
             sd_scaled = sd / (sd_scale * scale)
             if round(mean_scaled, 1) < 0.1:
                 continue
@@ -66,6 +67,39 @@ def dump_results(results: List[float], scale: float):
         print()
 
 
+def dump_native_prediction(attacker, defender, model_path: str = 'model.bin'):
+    from nn_infer import NnInfer
+
+    nn = NnInfer(model_path)
+    techs = np.zeros((1, 2, 3), dtype=np.uint8)
+    units = np.zeros((1, 2, NUM_UNITS), dtype=np.uint32)
+    for i, combatant in enumerate([attacker, defender]):
+        techs[0, i] = [combatant['weapons'], combatant['shielding'], combatant['armor']]
+        for kind, num_units in combatant['units'].items():
+            units[0, i, UNITS.index(kind)] = num_units
+    means, sds = nn.predict(techs, units)
+    for i in range(2):
+        for j, kind in enumerate(UNITS):
+            if round(float(means[0, i, j]), 1) < 0.1:
+                continue
+            print('{:15}\t{:.2f} ± {:.4f}'.format(kind, means[0, i, j], sds[0, i, j]))
+        print()
+
+
+def dump_simulation(attacker, defender, num_replicas: int = 1000):
+    from battle_engine import BattleEngine
+
+    engine = BattleEngine()
+    means, sds = engine.fight_one(attacker, defender, num_replicas)
+    for i in range(2):
+        for kind in UNITS:
+            j = engine.unit_kinds.index(kind)
+            if round(means[i, j], 1) < 0.1:
+                continue
+            print('{:15}\t{:.2f} ± {:.4f}'.format(kind, means[i, j], sds[i, j]))
+        print()
+
+
 def main():
     attacker = {
         'weapons': 10,
@@ -87,11 +121,22 @@ def main():
         }
     }
 
-    load_scales('scales')
-    model = load_model('model')
-    inputs, scale = make_input(attacker, defender)
-    prediction = model.predict([inputs])[0]
-    dump_results(prediction, scale)
+    # The model exported by export-model.py runs without TensorFlow (needs libnn-infer, see nn_infer.py).
+    if '--native' in sys.argv[1:]:
+        dump_native_prediction(attacker, defender)
+    else:
+        from tensorflow.keras.models import load_model
+
+        load_scales('scales')
+        model = load_model('model')
+        inputs, scale = make_input(attacker, defender)
+        prediction = model.predict([inputs])[0]
+        dump_results(prediction, scale)
+
+    # Compare with the simulator itself (needs libbattle-engine, see battle_engine.py).
+    if '--simulate' in sys.argv[1:]:
+        print('Simulated:')
+        dump_simulation(attacker, defender)
 
 
 if __name__ == '__main__':
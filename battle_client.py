@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+
+import argparse
+import json
+import random
+import socket
+import struct
+import threading
+import time
+from typing import Dict, List, Tuple
+
+import numpy as np
+
+# Keep in sync with dataset-gen/src/BattleServerProtocol.hpp
+SERVER_MAGIC = 0x5342474f
+SERVER_VERSION = 1
+FIGHT = 1
+STATS = 2
+STATUS_NAMES = {1: 'bad request', 2: 'unsupported'}
+FRAME_HEADER = struct.Struct('<IHBBII')
+FIGHT_REQUEST_HEADER = struct.Struct('<IIBBH')
+FIGHT_RESPONSE_HEADER = struct.Struct('<IHH')
+GROUP = struct.Struct('<BI')
+DEFAULT_SOCKET_PATH = 'battle-server.sock'
+
+
+class BattleClient:
+    """Connection to battle-server. Combatants are given as in battle.py."""
+
+    def __init__(self, socket_path: str = DEFAULT_SOCKET_PATH):
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._sock.connect(socket_path)
+        self._next_request_id = 0
+        self.unit_kinds: List[str] = self.stats()['unit_kinds']
+
+    def close(self):
+        self._sock.close()
+
+    def _recv_exactly(self, size: int) -> bytes:
+        data = bytearray()
+        while len(data) < size:
+            chunk = self._sock.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError('battle-server closed the connection')
+            data += chunk
+        return bytes(data)
+
+    def _request(self, request_type: int, payload: bytes) -> bytes:
+        request_id = self._next_request_id
+        self._next_request_id += 1
+        self._sock.sendall(FRAME_HEADER.pack(SERVER_MAGIC, SERVER_VERSION, request_type, 0, request_id, len(payload)) +
+                           payload)
+        magic, _, _, status, response_id, payload_size = FRAME_HEADER.unpack(self._recv_exactly(FRAME_HEADER.size))
+        response = self._recv_exactly(payload_size)
+        if magic != SERVER_MAGIC or response_id != request_id:
+            raise ConnectionError('Unexpected response from battle-server')
+        if status != 0:
+            raise ValueError('battle-server rejected the request: {}'.format(STATUS_NAMES.get(status, status)))
+        return response
+
+    def _pack_combatant(self, combatant: Dict) -> bytes:
+        groups = [(self.unit_kinds.index(kind), n) for kind, n in combatant['units'].items() if n > 0]
+        data = bytes([combatant['weapons'], combatant['shielding'], combatant['armor'], len(groups)])
+        return data + b''.join(GROUP.pack(kind, n) for kind, n in groups)
+
+    def fight(self, attackers: List[Dict], defenders: List[Dict], num_replicas: int = 100,
+              seed: int = 1) -> Tuple[np.ndarray, np.ndarray]:
+        """Returns the means and the standard deviations of the units left, (num_combatants, len(unit_kinds)) each,
+        attackers first."""
+        payload = FIGHT_REQUEST_HEADER.pack(num_replicas, seed, len(attackers), len(defenders), 0)
+        payload += b''.join(self._pack_combatant(c) for c in attackers + defenders)
+        response = self._request(FIGHT, payload)
+        _, num_combatants, num_unit_kinds = FIGHT_RESPONSE_HEADER.unpack_from(response)
+        values = np.frombuffer(response, dtype='<f8', offset=FIGHT_RESPONSE_HEADER.size)
+        values = values.reshape(2, num_combatants, num_unit_kinds)
+        return values[0], values[1]
+
+    def stats(self) -> Dict:
+        return json.loads(self._request(STATS, b''))
+
+
+def histogram_percentile(bounds: List, counts: List[int], q: float):
+    """Upper bound of the bucket holding the q quantile, None for the open last bucket."""
+    total = sum(counts)
+    seen = 0
+    for bound, count in zip(bounds, counts):
+        seen += count
+        if total > 0 and seen >= q * total:
+            return bound
+    return None
+
+
+def random_combatant(rng: random.Random, kinds: List[str], max_ships: int) -> Dict:
+    return {
+        'weapons': rng.randint(0, 20),
+        'shielding': rng.randint(0, 20),
+        'armor': rng.randint(0, 20),
+        'units': {kind: rng.randint(0, max_ships) for kind in rng.sample(kinds, 4)},
+    }
+
+
+def load_test(args):
+    """Sends random battles from concurrent clients and prints the throughput and the latencies."""
+    ships = ['SmallCargo', 'LargeCargo', 'LightFighter', 'HeavyFighter', 'Cruiser', 'Battleship', 'Bomber',
+             'Destroyer', 'Battlecruiser']
+    latencies = []
+    lock = threading.Lock()
+
+    def run_client(index: int):
+        client = BattleClient(args.socket)
+        rng = random.Random(index)
+        client_latencies = []
+        for _ in range(args.requests):
+            attacker = random_combatant(rng, ships, args.max_ships)
+            defender = random_combatant(rng, ships, args.max_ships)
+            start = time.perf_counter()
+            client.fight([attacker], [defender], args.replicas, rng.getrandbits(32))
+            client_latencies.append(time.perf_counter() - start)
+        client.close()
+        with lock:
+            latencies.extend(client_latencies)
+
+    start = time.perf_counter()
+    threads = [threading.Thread(target=run_client, args=(i,)) for i in range(args.clients)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    seconds = time.perf_counter() - start
+
+    latencies_us = np.array(latencies) * 1e6
+    print('requests/sec:   {:.1f}'.format(len(latencies) / seconds))
+    print('client latency: p50 {:.0f} us, p99 {:.0f} us'.format(*np.percentile(latencies_us, [50, 99])))
+
+    stats = BattleClient(args.socket).stats()
+    bounds = stats['latency_us']['upper_bounds']
+    for name in ['queue', 'total']:
+        counts = stats['latency_us'][name]
+        print('server {:6}  p50 < {} us, p99 < {} us'.format(
+            name + ':', histogram_percentile(bounds, counts, 0.5), histogram_percentile(bounds, counts, 0.99)))
+    print('batches: {}, requests per batch: {:.1f}'.format(stats['batches'], stats['requests'] / stats['batches']))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Load test of battle-server.')
+    parser.add_argument('--socket', default=DEFAULT_SOCKET_PATH, help='Socket path (default: battle-server.sock)')
+    parser.add_argument('--clients', type=int, default=8, help='Concurrent connections (default: 8)')
+    parser.add_argument('--requests', type=int, default=100, help='Requests per connection (default: 100)')
+    parser.add_argument('--replicas', type=int, default=100, help='Replicas per request (default: 100)')
+    parser.add_argument('--max-ships', type=int, default=100, help='Max ships per unit kind (default: 100)')
+    load_test(parser.parse_args())
+
+
+if __name__ == '__main__':
+    main()
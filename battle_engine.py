@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+
+import ctypes
+import os
+from typing import List, Optional, Tuple
+
+import numpy as np
+
+# Keep in sync with dataset-gen/src/BattleEngineApi.h
+API_VERSION = 2
+NUM_TECHS = 3
+DEFAULT_LIBRARY_PATH = 'build/libbattle-engine.so'
+
+
+class BattleEngine:
+    """The battle simulator of dataset-gen, through the C API of libbattle-engine.
+
+    Set BATTLE_ENGINE_LIBRARY or pass library_path to load the library from another path than build/."""
+
+    def __init__(self, library_path: Optional[str] = None, num_threads: int = 0):
+        # Set first, so that __del__ works even if loading the library fails.
+        self._engine = None
+        path = library_path or os.environ.get('BATTLE_ENGINE_LIBRARY', DEFAULT_LIBRARY_PATH)
+        self._lib = ctypes.CDLL(path)
+        self._lib.battle_engine_api_version.restype = ctypes.c_uint32
+        self._lib.battle_engine_num_unit_kinds.restype = ctypes.c_uint32
+        self._lib.battle_engine_unit_name.argtypes = [ctypes.c_uint32]
+        self._lib.battle_engine_unit_name.restype = ctypes.c_char_p
+        self._lib.battle_engine_create.argtypes = [ctypes.c_uint32]
+        self._lib.battle_engine_create.restype = ctypes.c_void_p
+        self._lib.battle_engine_destroy.argtypes = [ctypes.c_void_p]
+        self._lib.battle_engine_fight.argtypes = [
+            ctypes.c_void_p, ctypes.c_size_t,
+            ctypes.c_void_p, ctypes.c_void_p,
+            ctypes.c_uint32, ctypes.c_uint32,
+            ctypes.c_void_p, ctypes.c_void_p,
+        ]
+        self._lib.battle_engine_fight.restype = ctypes.c_int
+
+        version = self._lib.battle_engine_api_version()
+        if version != API_VERSION:
+            raise RuntimeError('Unsupported battle engine API version {}'.format(version))
+
+        num_kinds = self._lib.battle_engine_num_unit_kinds()
+        self.unit_kinds: List[str] = [self._lib.battle_engine_unit_name(i).decode() for i in range(num_kinds)]
+        self._engine = self._lib.battle_engine_create(num_threads)
+
+    def close(self):
+        if self._engine is not None:
+            self._lib.battle_engine_destroy(self._engine)
+            self._engine = None
+
+    def __del__(self):
+        self.close()
+
+    def fight(self, techs: np.ndarray, units: np.ndarray, num_replicas: int = 100, seed: int = 1,
+              out_means: Optional[np.ndarray] = None,
+              out_sds: Optional[np.ndarray] = None) -> Tuple[np.ndarray, np.ndarray]:
+        """Fights num_replicas replicas of each battle.
+
+        techs has shape (num_battles, 2, 3): weapons, shielding and armor of the attacker and the defender.
+        units has shape (num_battles, 2, len(unit_kinds)). Arrays that are already contiguous uint8 and uint32 are
+        passed without copies. Returns the means and the standard deviations of the units left, with the shape of
+        units. They are written in place into out_means and out_sds if given, C-contiguous float64 arrays of that
+        shape, otherwise into new arrays."""
+        techs = np.ascontiguousarray(techs, dtype=np.uint8)
+        units = np.ascontiguousarray(units, dtype=np.uint32)
+        num_battles = units.shape[0]
+        if techs.shape != (num_battles, 2, NUM_TECHS) or units.shape != (num_battles, 2, len(self.unit_kinds)):
+            raise ValueError('techs must have shape (n, 2, {}) and units (n, 2, {})'.format(
+                NUM_TECHS, len(self.unit_kinds)))
+
+        means = self._output(out_means, 'out_means', units.shape)
+        sds = self._output(out_sds, 'out_sds', units.shape)
+        status = self._lib.battle_engine_fight(self._engine, num_battles, techs.ctypes.data, units.ctypes.data,
+                                               num_replicas, seed, means.ctypes.data, sds.ctypes.data)
+        if status != 0:
+            raise ValueError('battle_engine_fight failed with status {}'.format(status))
+        return means, sds
+
+    @staticmethod
+    def _output(out: Optional[np.ndarray], name: str, shape: Tuple[int, ...]) -> np.ndarray:
+        if out is None:
+            return np.empty(shape, dtype=np.float64)
+        if (out.dtype != np.float64 or out.shape != shape or not out.flags['C_CONTIGUOUS']
+                or not out.flags['WRITEABLE']):
+            raise ValueError('{} must be a writeable C-contiguous float64 array of shape {}'.format(name, shape))
+        return out
+
+    def fight_one(self, attacker, defender, num_replicas: int = 100, seed: int = 1) -> Tuple[np.ndarray, np.ndarray]:
+        """fight() for a single battle between combatants given as in battle.py."""
+        techs = np.zeros((1, 2, NUM_TECHS), dtype=np.uint8)
+        units = np.zeros((1, 2, len(self.unit_kinds)), dtype=np.uint32)
+        for i, combatant in enumerate([attacker, defender]):
+            techs[0, i] = [combatant['weapons'], combatant['shielding'], combatant['armor']]
+            for kind, num_units in combatant['units'].items():
+                units[0, i, self.unit_kinds.index(kind)] = num_units
+        means, sds = self.fight(techs, units, num_replicas, seed)
+        return means[0], sds[0]
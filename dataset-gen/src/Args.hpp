@@ -0,0 +1,25 @@
+#ifndef DATASET_GEN_ARGS_HPP
+#define DATASET_GEN_ARGS_HPP
+
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace dataset_gen {
+
+// Parses the integer argument of the option name, exiting with an error if it is missing, not an integer or out of
+// the range of T.
+template <typename T> T parse_int_arg_or_die(const char *arg, const char *name) {
+  if (arg != nullptr) {
+    T result;
+    if (auto [_, ec] = std::from_chars(arg, arg + std::strlen(arg), result); ec == std::errc())
+      return result;
+  }
+  std::cerr << "Failed to parse argument " << name << '\n';
+  std::exit(1);
+}
+
+} // namespace dataset_gen
+
+#endif // !DATASET_GEN_ARGS_HPP
@@ -1,160 +1,1689 @@
 #include "BattleEngine.hpp"
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <limits>
 #include <numeric>
+#include <span>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(DATASET_GEN_STATS) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+#include "ThreadPool.hpp"
 #include "Units.hpp"
 #include "Util.hpp"
 
+// The unit passes have three implementations, selected at compile time: AVX-512 (needs F, BW, VL and VBMI2 for the
+// compress instructions), AVX2 and a scalar fallback. All of them produce the same units in the same order.
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VL__) && defined(__AVX512VBMI2__)
+#define DATASET_GEN_UNITS_AVX512 1
+#elif defined(__AVX2__)
+#define DATASET_GEN_UNITS_AVX2 1
+#endif
+
 namespace dataset_gen {
 
 namespace {
 
-Party create_party(std::vector<Combatant> &combatants) {
+constexpr std::uint32_t round_up_units(std::uint32_t n) { return (n + unit_padding - 1) / unit_padding * unit_padding; }
+
+constexpr std::uint32_t slot_of(std::uint8_t combatant_id, std::uint8_t kind) {
+  return static_cast<std::uint32_t>(combatant_id) * UnitKindEnd + kind;
+}
+
+#if defined(DATASET_GEN_UNITS_AVX2)
+// Shuffles moving the alive lanes of an 8-lane mask to the front, for floats (permutevar8x32) and bytes (pshufb).
+struct CompactLut {
+  alignas(32) std::int32_t lanes[256][8];
+  alignas(16) std::uint8_t bytes[256][16];
+};
+
+constexpr CompactLut make_compact_lut() {
+  CompactLut lut{};
+  for (std::uint32_t mask = 0; mask < 256; ++mask) {
+    std::uint32_t n = 0;
+    for (std::uint32_t lane = 0; lane < 8; ++lane) {
+      if ((mask & (1u << lane)) != 0) {
+        lut.lanes[mask][n] = static_cast<std::int32_t>(lane);
+        lut.bytes[mask][n] = static_cast<std::uint8_t>(lane);
+        ++n;
+      }
+    }
+    // 0x80 zeroes the byte, so the unused lanes get kind 0 of combatant 0, which is a valid shield table index.
+    for (; n < 16; ++n)
+      lut.bytes[mask][n] = 0x80;
+  }
+  return lut;
+}
+
+constexpr CompactLut compact_lut = make_compact_lut();
+#endif
+
+float unit_damage(std::uint8_t kind, const CombatTechs &techs) {
+  return unit_attrs[kind].weapons * (1.0f + 0.1f * techs.weapons);
+}
+
+float unit_max_shield(std::uint8_t kind, const CombatTechs &techs) {
+  return unit_attrs[kind].shield * (1.0f + 0.1f * techs.shielding);
+}
+
+// Whether no shot of the shooters can change a unit of the targets: a shot without damage changes nothing, and one
+// below 1% of the shield of its target bounces without taking anything off the shield (see compile_fire_table()).
+bool is_harmless(std::span<const Combatant> shooters, std::span<const Combatant> targets) {
+  for (const Combatant &shooter : shooters) {
+    for (std::uint8_t shooter_kind = 0; shooter_kind < UnitKindEnd; ++shooter_kind) {
+      const float damage = unit_damage(shooter_kind, shooter.techs);
+      if (shooter.unit_groups[shooter_kind] == 0 || damage == 0.0f)
+        continue;
+      for (const Combatant &target : targets) {
+        for (std::uint8_t target_kind = 0; target_kind < UnitKindEnd; ++target_kind) {
+          const float max_shield = unit_max_shield(target_kind, target.techs);
+          if (target.unit_groups[target_kind] != 0 &&
+              !(damage < max_shield && std::floor(100.0f * damage / max_shield) == 0.0f))
+            return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool has_units(std::span<const Combatant> combatants) {
+  return std::ranges::any_of(combatants, [](const Combatant &combatant) {
+    return std::ranges::any_of(combatant.unit_groups, [](std::uint32_t n) { return n != 0; });
+  });
+}
+
+// Fills the per-battle constants of the party: the restored shields and the slot tables.
+void create_slots(Party &party, std::span<const Combatant> combatants) {
   assert(combatants.size() <= std::numeric_limits<std::uint8_t>::max());
 
+  party.combatants = combatants;
+
+  party.max_shields.resize(combatants.size() * UnitKindEnd);
+  for (std::size_t i = 0; i < combatants.size(); ++i) {
+    for (std::uint8_t kind = 0; kind < UnitKindEnd; ++kind)
+      party.max_shields[slot_of(static_cast<std::uint8_t>(i), kind)] = unit_max_shield(kind, combatants[i].techs);
+  }
+
+  party.slots.resize(combatants.size() * UnitKindEnd);
+  party.slot_kinds.clear();
+  party.slot_combatant_ids.clear();
+  party.slot_damages.clear();
+  party.slot_max_shields.clear();
+  party.slot_max_hulls.clear();
+  party.slot_explosion_hulls.clear();
+  for (std::size_t i = 0; i < combatants.size(); ++i) {
+    const auto &combatant = combatants[i];
+    for (std::uint8_t kind = 0; kind < UnitKindEnd; ++kind) {
+      if (combatant.unit_groups[kind] == 0)
+        continue;
+      const std::uint32_t slot = slot_of(static_cast<std::uint8_t>(i), kind);
+      party.slots[slot] = static_cast<std::uint16_t>(party.slot_kinds.size());
+      party.slot_kinds.push_back(kind);
+      party.slot_combatant_ids.push_back(static_cast<std::uint8_t>(i));
+      party.slot_damages.push_back(unit_damage(kind, combatant.techs));
+      party.slot_max_shields.push_back(party.max_shields[slot]);
+      const float max_hull = 0.1f * unit_attrs[kind].armor * (1.0f + 0.1f * combatant.techs.armor);
+      party.slot_max_hulls.push_back(max_hull);
+      party.slot_explosion_hulls.push_back(0.7f * max_hull);
+    }
+  }
+}
+
+// Fills the party with the units of the combatants. The party keeps the capacity of its buffers, so filling it again
+// does not allocate unless the battle is larger than all the previous ones.
+void create_party(Party &party, std::span<const Combatant> combatants) {
+  create_slots(party, combatants);
+
   std::uint32_t total_units = 0;
   for (const auto &combatant : combatants)
     total_units += std::accumulate(combatant.unit_groups.cbegin(), combatant.unit_groups.cend(), std::uint32_t{0});
 
-  std::vector<Unit> units{};
-  units.reserve(total_units);
+  const std::uint32_t padded_units = round_up_units(total_units);
+  party.shields.resize(padded_units);
+  party.hulls.resize(padded_units);
+  party.kinds.resize(padded_units);
+  party.combatant_ids.resize(padded_units);
+
+  std::uint32_t n = 0;
   for (std::size_t i = 0; i < combatants.size(); ++i) {
     const auto &combatant = combatants[i];
+    const auto combatant_id = static_cast<std::uint8_t>(i);
     for (std::uint8_t kind = 0; kind < combatant.unit_groups.size(); ++kind) {
-      float max_hull = 0.1f * unit_attrs[kind].armor * (1.0f + 0.1f * combatant.techs.armor);
-      for (std::uint32_t j = 0; j < combatant.unit_groups[kind]; ++j)
-        units.push_back(Unit{
-            .shield = 0.0f,
-            .hull = max_hull,
-            .kind = kind,
-            .combatant_id = static_cast<std::uint8_t>(i),
-        });
+      const float max_shield = party.max_shields[slot_of(combatant_id, kind)];
+      const float max_hull = 0.1f * unit_attrs[kind].armor * (1.0f + 0.1f * combatant.techs.armor);
+      const std::uint32_t end = n + combatant.unit_groups[kind];
+      std::fill(party.shields.data() + n, party.shields.data() + end, max_shield);
+      std::fill(party.hulls.data() + n, party.hulls.data() + end, max_hull);
+      std::fill(party.kinds.data() + n, party.kinds.data() + end, kind);
+      std::fill(party.combatant_ids.data() + n, party.combatant_ids.data() + end, combatant_id);
+      n = end;
     }
   }
 
-  return {
-      .combatants = combatants,
-      .units = std::move(units),
-      .num_alive = total_units,
-  };
+  // The padding may hold units of a previous battle; make it dead units of a valid slot.
+  std::fill(party.hulls.data() + n, party.hulls.data() + padded_units, 0.0f);
+  std::fill(party.kinds.data() + n, party.kinds.data() + padded_units, std::uint8_t{0});
+  std::fill(party.combatant_ids.data() + n, party.combatant_ids.data() + padded_units, std::uint8_t{0});
+
+  party.num_alive = total_units;
 }
 
-void restore_shields(Party &party) {
-  for (std::uint32_t i = 0; i < party.num_alive; ++i) {
-    Unit &unit = party.units[i];
-    unit.shield = unit_attrs[unit.kind].shield * (1.0f + 0.1f * party.combatants[unit.combatant_id].techs.shielding);
+void compile_fire_table(const Party &shooters, const Party &targets, FireTable &table) {
+  const auto num_shooter_slots = static_cast<std::uint32_t>(shooters.slot_kinds.size());
+  const auto num_target_slots = static_cast<std::uint32_t>(targets.slot_kinds.size());
+
+  table.num_target_slots = num_target_slots;
+  table.shield_damages.resize(num_shooter_slots * num_target_slots);
+  table.shield_percents.resize(num_shooter_slots * num_target_slots);
+  table.rapid_fires.resize(num_shooter_slots * num_target_slots);
+  for (std::uint32_t i = 0; i < num_shooter_slots; ++i) {
+    const float damage = shooters.slot_damages[i];
+    const UnitAttrs &shooter_attrs = unit_attrs[shooters.slot_kinds[i]];
+    for (std::uint32_t j = 0; j < num_target_slots; ++j) {
+      const std::uint32_t index = i * num_target_slots + j;
+      const float max_shield = targets.slot_max_shields[j];
+      // Shields only absorb hits when they are stronger than the damage, so a slot without shields never uses this.
+      const float percents = max_shield != 0.0f ? std::min(std::floor(100.0f * damage / max_shield), 100.0f) : 100.0f;
+      table.shield_damages[index] = 0.01f * percents * max_shield;
+      table.shield_percents[index] = static_cast<std::uint8_t>(percents);
+      table.rapid_fires[index] = shooter_attrs.rapid_fire[targets.slot_kinds[j]];
+    }
   }
 }
 
-void fire(const Party &attackers_party, Party &defenders_party, std::uint32_t &random) {
-  std::uint32_t r = random;
+// Hooks of the battle loops and of the fire passes. NoProbe compiles away; PhaseProbe times the phases and counts the
+// shots for fight_timed(); StatsProbe keeps the EngineStats of the workspace.
+struct NoProbe {
+  void shooter(std::uint8_t) {}
+  void shot(std::uint8_t) {}
+  void dead_target_hit() {}
+  void shield_bounce() {}
+  void explosion_roll() {}
+  void explosion_kill() {}
+  void end_phase(BattlePhase) {}
+  void end_battle(std::uint32_t) {}
+};
+
+struct PhaseProbe : NoProbe {
+  PhaseTimes &times;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  explicit PhaseProbe(PhaseTimes &times) : times{times} {}
+
+  void shot(std::uint8_t) { ++times.shots; }
+
+  void end_phase(BattlePhase phase) {
+    const auto now = std::chrono::steady_clock::now();
+    times.ns[static_cast<std::size_t>(phase)] +=
+        static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count());
+    start = now;
+  }
 
-  const Combatant *attackers = attackers_party.combatants.data();
-  const Unit *shooters = attackers_party.units.data();
+  void end_battle(std::uint32_t rounds) { times.rounds += rounds; }
+};
+
+#if defined(DATASET_GEN_STATS)
+std::uint64_t read_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+struct StatsProbe {
+  EngineStats &stats;
+  std::uint64_t start = read_ticks();
+
+  explicit StatsProbe(EngineStats &stats) : stats{stats} {}
+
+  void shooter(std::uint8_t kind) { ++stats.shooters[kind]; }
+  void shot(std::uint8_t kind) { ++stats.shots[kind]; }
+  void dead_target_hit() { ++stats.dead_target_hits; }
+  void shield_bounce() { ++stats.shield_bounces; }
+  void explosion_roll() { ++stats.explosion_rolls; }
+  void explosion_kill() { ++stats.explosion_kills; }
+
+  void end_phase(BattlePhase phase) {
+    const std::uint64_t now = read_ticks();
+    stats.phase_ticks[static_cast<std::size_t>(phase)] += now - start;
+    start = now;
+  }
+
+  void end_battle(std::uint32_t rounds) {
+    ++stats.battles;
+    ++stats.rounds[rounds];
+  }
+};
+
+using FightProbe = StatsProbe;
+#else
+struct FightProbe : NoProbe {
+  explicit FightProbe(EngineStats &) {}
+};
+#endif
+
+template <typename Rng, typename Probe>
+void fire(const Party &attackers_party, Party &defenders_party, const FireTable &table, Rng &rng, Probe &probe) {
+  std::uint32_t r;
+
+  const std::uint8_t *shooter_kinds = attackers_party.kinds.data();
+  const std::uint8_t *shooter_combatant_ids = attackers_party.combatant_ids.data();
+  const std::uint16_t *shooter_slots = attackers_party.slots.data();
   std::uint32_t num_shooters = attackers_party.num_alive;
 
-  const Combatant *defenders = defenders_party.combatants.data();
-  Unit *targets = defenders_party.units.data();
+  float *target_shields = defenders_party.shields.data();
+  float *target_hulls = defenders_party.hulls.data();
+  const std::uint8_t *target_kinds = defenders_party.kinds.data();
+  const std::uint8_t *target_combatant_ids = defenders_party.combatant_ids.data();
+  const std::uint16_t *target_slots = defenders_party.slots.data();
+  const float *max_hulls = defenders_party.slot_max_hulls.data();
+  const float *explosion_hulls = defenders_party.slot_explosion_hulls.data();
   std::uint32_t num_targets = defenders_party.num_alive;
 
   for (std::uint32_t i = 0; i < num_shooters; ++i) {
-    const Unit &shooter = shooters[i];
-    const UnitAttrs &shooter_attrs = unit_attrs[shooter.kind];
-
-    const float damage = shooter_attrs.weapons * (1.0f + 0.1f * attackers[shooter.combatant_id].techs.weapons);
+    const std::uint32_t shooter_slot = shooter_slots[slot_of(shooter_combatant_ids[i], shooter_kinds[i])];
+    const float damage = attackers_party.slot_damages[shooter_slot];
+    const float *shield_damages = &table.shield_damages[shooter_slot * table.num_target_slots];
+    const std::uint32_t *rapid_fires = &table.rapid_fires[shooter_slot * table.num_target_slots];
     std::uint32_t rapid_fire;
+    probe.shooter(shooter_kinds[i]);
 
     do {
-      r = random_next(r);
-      Unit &target = targets[r % num_targets];
-      const UnitAttrs &target_attrs = unit_attrs[target.kind];
-      const Combatant &defender = defenders[target.combatant_id];
+      probe.shot(shooter_kinds[i]);
+      r = rng.next();
+      const std::uint32_t target = r % num_targets;
+      const std::uint32_t target_slot = target_slots[slot_of(target_combatant_ids[target], target_kinds[target])];
 
-      if (target.hull != 0.0f) {
-        float hull = target.hull;
-        float hull_damage = damage - target.shield;
+      if (target_hulls[target] != 0.0f) {
+        float hull = target_hulls[target];
+        float hull_damage = damage - target_shields[target];
 
         if (hull_damage < 0.0f) {
-          const float max_shield = target_attrs.shield * (1.0f + 0.1f * defender.techs.shielding);
-          float shield_damage = 0.01f * std::floor(100.0f * damage / max_shield) * max_shield;
-          target.shield -= shield_damage;
+          probe.shield_bounce();
+          target_shields[target] -= shield_damages[target_slot];
         } else {
-          target.shield = 0.0f;
+          target_shields[target] = 0.0f;
           if (hull_damage > hull)
             hull_damage = hull;
           hull -= hull_damage;
         }
 
+        if (hull != 0.0f && hull < explosion_hulls[target_slot]) {
+          probe.explosion_roll();
+          r = rng.next();
+          if (hull < (1.0f / static_cast<float>(Rng::max)) * static_cast<float>(r) * max_hulls[target_slot]) {
+            probe.explosion_kill();
+            hull = 0.0f;
+          }
+        }
+        target_hulls[target] = hull;
+      } else {
+        probe.dead_target_hit();
+      }
+
+      rapid_fire = rapid_fires[target_slot];
+    } while (rapid_fire != 0 && (r = rng.next()) % rapid_fire != 0);
+  }
+}
+
+// Removes the destroyed units, keeping the order of the alive ones, and restores the shields of the alive units for
+// the next round.
+void update_units(Party &party) {
+  float *shields = party.shields.data();
+  float *hulls = party.hulls.data();
+  std::uint8_t *kinds = party.kinds.data();
+  std::uint8_t *combatant_ids = party.combatant_ids.data();
+  const float *max_shields = party.max_shields.data();
+
+  const std::uint32_t end = round_up_units(party.num_alive);
+  std::uint32_t n = 0;
+  std::uint32_t i = 0;
+
+#if defined(DATASET_GEN_UNITS_AVX512)
+  DATASET_GEN_AVX512_BEGIN
+  const __m512i num_kinds = _mm512_set1_epi32(UnitKindEnd);
+  for (; i < end; i += 16) {
+    const __m512 hull = _mm512_load_ps(hulls + i);
+    const __mmask16 alive = _mm512_cmp_ps_mask(hull, _mm512_setzero_ps(), _CMP_NEQ_OQ);
+    const __m128i kind =
+        _mm_maskz_compress_epi8(alive, _mm_load_si128(reinterpret_cast<const __m128i *>(kinds + i)));
+    const __m128i combatant_id =
+        _mm_maskz_compress_epi8(alive, _mm_load_si128(reinterpret_cast<const __m128i *>(combatant_ids + i)));
+    const __m512i slot = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_cvtepu8_epi32(combatant_id), num_kinds),
+                                          _mm512_cvtepu8_epi32(kind));
+
+    _mm512_storeu_ps(hulls + n, _mm512_maskz_compress_ps(alive, hull));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(kinds + n), kind);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(combatant_ids + n), combatant_id);
+    _mm512_storeu_ps(shields + n, _mm512_i32gather_ps(slot, max_shields, 4));
+    n += static_cast<std::uint32_t>(std::popcount(static_cast<std::uint32_t>(alive)));
+  }
+  DATASET_GEN_AVX512_END
+#elif defined(DATASET_GEN_UNITS_AVX2)
+  const __m256i num_kinds = _mm256_set1_epi32(UnitKindEnd);
+  for (; i < end; i += 8) {
+    const __m256 hull = _mm256_load_ps(hulls + i);
+    const int alive = _mm256_movemask_ps(_mm256_cmp_ps(hull, _mm256_setzero_ps(), _CMP_NEQ_OQ));
+    const __m256i lanes = _mm256_load_si256(reinterpret_cast<const __m256i *>(compact_lut.lanes[alive]));
+    const __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i *>(compact_lut.bytes[alive]));
+    const __m128i kind = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(kinds + i)), bytes);
+    const __m128i combatant_id =
+        _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(combatant_ids + i)), bytes);
+    const __m256i slot = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvtepu8_epi32(combatant_id), num_kinds),
+                                          _mm256_cvtepu8_epi32(kind));
+
+    _mm256_storeu_ps(hulls + n, _mm256_permutevar8x32_ps(hull, lanes));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(kinds + n), kind);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(combatant_ids + n), combatant_id);
+    _mm256_storeu_ps(shields + n, _mm256_i32gather_ps(max_shields, slot, 4));
+    n += static_cast<std::uint32_t>(std::popcount(static_cast<std::uint32_t>(alive)));
+  }
+#endif
+
+  for (; i < party.num_alive; ++i) {
+    if (hulls[i] != 0.0f) {
+      hulls[n] = hulls[i];
+      kinds[n] = kinds[i];
+      combatant_ids[n] = combatant_ids[i];
+      shields[n] = max_shields[slot_of(combatant_ids[i], kinds[i])];
+      ++n;
+    }
+  }
+
+  std::fill(hulls + n, hulls + end, 0.0f);
+  party.num_alive = n;
+}
+
+// Counts the alive units of each combatant into unit_groups, which has an entry per combatant of the party.
+void count_units(const Party &party, std::span<UnitGroups<std::uint32_t>> unit_groups) {
+  assert(unit_groups.size() == party.combatants.size());
+  for (auto &groups : unit_groups)
+    std::fill(groups.begin(), groups.end(), 0);
+
+  const std::uint8_t *kinds = party.kinds.data();
+  const std::uint8_t *combatant_ids = party.combatant_ids.data();
+  std::uint32_t i = 0;
+
+#if defined(DATASET_GEN_UNITS_AVX512) || defined(DATASET_GEN_UNITS_AVX2)
+  // With a single combatant all kinds are counted in one pass, by comparing whole vectors of kinds with each kind.
+  if (party.combatants.size() == 1) {
+    auto &groups = unit_groups[0];
+#if defined(DATASET_GEN_UNITS_AVX512)
+    const std::uint32_t vector_end = party.num_alive / 64 * 64;
+    for (; i < vector_end; i += 64) {
+      const __m512i kind = _mm512_load_si512(kinds + i);
+      for (std::uint8_t k = 0; k < UnitKindEnd; ++k) {
+        const __mmask64 mask = _mm512_cmpeq_epi8_mask(kind, _mm512_set1_epi8(static_cast<char>(k)));
+        groups[k] += static_cast<std::uint32_t>(std::popcount(mask));
+      }
+    }
+#else
+    const std::uint32_t vector_end = party.num_alive / 32 * 32;
+    for (; i < vector_end; i += 32) {
+      const __m256i kind = _mm256_load_si256(reinterpret_cast<const __m256i *>(kinds + i));
+      for (std::uint8_t k = 0; k < UnitKindEnd; ++k) {
+        const int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(kind, _mm256_set1_epi8(static_cast<char>(k))));
+        groups[k] += static_cast<std::uint32_t>(std::popcount(static_cast<std::uint32_t>(mask)));
+      }
+    }
+#endif
+  }
+#endif
+
+  for (; i < party.num_alive; ++i)
+    ++unit_groups[combatant_ids[i]][kinds[i]];
+}
+
+// Replica lanes
+//
+// Every lane fights replicas of the battle one after another, running the scalar passes above with the same arithmetic
+// and the same random numbers, so a replica ends the same as with fight(). A step fires one shot in every busy lane;
+// the rest (phase changes, update_units(), starting the next replica) is done per lane between the steps, when the
+// lane runs out of shooters.
+
+constexpr std::uint32_t lane_unit_size = 2 * sizeof(float) + sizeof(std::uint32_t);
+// Targets are picked at random, so the lanes only pay off while their units mostly stay in the cache.
+constexpr std::uint64_t lane_footprint_limit = 4 * 1024 * 1024;
+
+// Lanes used when fight_replicas() picks them: 16 with the vectorized step, otherwise none.
+template <typename Rng>
+constexpr std::uint32_t default_lanes =
+#if defined(DATASET_GEN_UNITS_AVX512)
+    is_lehmer_sequence<Rng> ? 16 : 1;
+#else
+    1;
+#endif
+
+// Builds the lane battle from the parties and fire tables of the workspace.
+void compile_lane_battle(BattleWorkspace &workspace, std::uint32_t num_lanes) {
+  LaneBattle &battle = workspace.lanes;
+  const Party *parties[] = {&workspace.attackers, &workspace.defenders};
+  const FireTable *tables[] = {&workspace.attackers_table, &workspace.defenders_table};
+
+  const auto num_attacker_slots = static_cast<std::uint32_t>(workspace.attackers.slot_kinds.size());
+  const std::uint32_t slot_offsets[] = {0, num_attacker_slots};
+  battle.num_lanes = num_lanes;
+  battle.num_slots = num_attacker_slots + static_cast<std::uint32_t>(workspace.defenders.slot_kinds.size());
+
+  battle.slot_kinds.clear();
+  battle.slot_combatant_ids.clear();
+  battle.slot_damages.clear();
+  battle.slot_max_shields.clear();
+  battle.slot_max_hulls.clear();
+  battle.slot_explosion_hulls.clear();
+  battle.shield_damages.assign(battle.num_slots * battle.num_slots, 0.0f);
+  battle.rapid_fires.assign(battle.num_slots * battle.num_slots, 0);
+  battle.rapid_fire_inverses.assign(battle.num_slots * battle.num_slots, 0.0);
+  battle.initial_shields.clear();
+  battle.initial_hulls.clear();
+  battle.initial_slots.clear();
+
+  for (std::uint32_t side = 0; side < 2; ++side) {
+    const Party &party = *parties[side];
+    battle.slot_kinds.insert(battle.slot_kinds.end(), party.slot_kinds.begin(), party.slot_kinds.end());
+    battle.slot_combatant_ids.insert(battle.slot_combatant_ids.end(), party.slot_combatant_ids.begin(),
+                                     party.slot_combatant_ids.end());
+    battle.slot_damages.insert(battle.slot_damages.end(), party.slot_damages.begin(), party.slot_damages.end());
+    battle.slot_max_shields.insert(battle.slot_max_shields.end(), party.slot_max_shields.begin(),
+                                   party.slot_max_shields.end());
+    battle.slot_max_hulls.insert(battle.slot_max_hulls.end(), party.slot_max_hulls.begin(),
+                                 party.slot_max_hulls.end());
+    battle.slot_explosion_hulls.insert(battle.slot_explosion_hulls.end(), party.slot_explosion_hulls.begin(),
+                                       party.slot_explosion_hulls.end());
+
+    const FireTable &table = *tables[side];
+    const std::uint32_t num_shooter_slots = static_cast<std::uint32_t>(party.slot_kinds.size());
+    for (std::uint32_t i = 0; i < num_shooter_slots; ++i) {
+      for (std::uint32_t j = 0; j < table.num_target_slots; ++j) {
+        const std::uint32_t index = (slot_offsets[side] + i) * battle.num_slots + slot_offsets[1 - side] + j;
+        battle.shield_damages[index] = table.shield_damages[i * table.num_target_slots + j];
+        battle.rapid_fires[index] = table.rapid_fires[i * table.num_target_slots + j];
+        battle.rapid_fire_inverses[index] = 1.0 / battle.rapid_fires[index];
+      }
+    }
+
+    battle.num_units[side] = party.num_alive;
+    for (std::uint32_t i = 0; i < party.num_alive; ++i) {
+      battle.initial_shields.push_back(party.shields[i]);
+      battle.initial_hulls.push_back(party.hulls[i]);
+      battle.initial_slots.push_back(slot_offsets[side] + party.slots[slot_of(party.combatant_ids[i], party.kinds[i])]);
+    }
+  }
+
+  const std::uint32_t total_units = battle.num_units[0] + battle.num_units[1];
+  battle.shields.resize(total_units * num_lanes);
+  battle.hulls.resize(total_units * num_lanes);
+  battle.slots.resize(total_units * num_lanes);
+}
+
+// State of the lanes. A lane is busy while shooters < shooters_end; it fires at the units
+// [target_offsets, target_offsets + num_targets).
+template <typename Rng, std::uint32_t Lanes> struct LaneState {
+  alignas(64) std::array<std::uint32_t, Lanes> shooters{};
+  alignas(64) std::array<std::uint32_t, Lanes> shooters_end{};
+  alignas(64) std::array<std::uint32_t, Lanes> target_offsets{};
+  alignas(64) std::array<std::uint32_t, Lanes> num_targets{};
+  alignas(64) std::array<double, Lanes> target_inverses{};
+  std::array<Rng, Lanes> rngs;
+
+  std::array<std::uint32_t, Lanes> num_alive[2]{};
+  std::array<std::uint32_t, Lanes> sides{};
+  std::array<std::uint32_t, Lanes> rounds{};
+  std::array<std::size_t, Lanes> replicas{};
+
+  LaneState() : rngs{make_rngs(std::make_index_sequence<Lanes>{})} {}
+
+  template <std::size_t... I> static std::array<Rng, Lanes> make_rngs(std::index_sequence<I...>) {
+    return {Rng{static_cast<std::uint32_t>(I)}...};
+  }
+};
+
+// Fires one shot in each busy lane and returns the mask of the lanes that fired their last shot.
+template <typename Rng, std::uint32_t Lanes> std::uint32_t fire_step(LaneBattle &battle, LaneState<Rng, Lanes> &state) {
+  std::uint32_t done = 0;
+  for (std::uint32_t lane = 0; lane < Lanes; ++lane) {
+    if (state.shooters[lane] == state.shooters_end[lane])
+      continue;
+
+    Rng &rng = state.rngs[lane];
+    const std::uint32_t shooter_slot = battle.slots[state.shooters[lane] * Lanes + lane];
+    std::uint32_t r = rng.next();
+    const std::uint32_t target = (state.target_offsets[lane] + r % state.num_targets[lane]) * Lanes + lane;
+    const std::uint32_t target_slot = battle.slots[target];
+    const std::uint32_t index = shooter_slot * battle.num_slots + target_slot;
+
+    if (battle.hulls[target] != 0.0f) {
+      float hull = battle.hulls[target];
+      float hull_damage = battle.slot_damages[shooter_slot] - battle.shields[target];
+
+      if (hull_damage < 0.0f) {
+        battle.shields[target] -= battle.shield_damages[index];
+      } else {
+        battle.shields[target] = 0.0f;
+        if (hull_damage > hull)
+          hull_damage = hull;
+        hull -= hull_damage;
+      }
+
+      if (hull != 0.0f && hull < battle.slot_explosion_hulls[target_slot]) {
+        r = rng.next();
+        if (hull < (1.0f / static_cast<float>(Rng::max)) * static_cast<float>(r) * battle.slot_max_hulls[target_slot])
+          hull = 0.0f;
+      }
+      battle.hulls[target] = hull;
+    }
+
+    const std::uint32_t rapid_fire = battle.rapid_fires[index];
+    if (rapid_fire == 0 || rng.next() % rapid_fire == 0) {
+      if (++state.shooters[lane] == state.shooters_end[lane])
+        done |= 1u << lane;
+    }
+  }
+  return done;
+}
+
+#if defined(DATASET_GEN_UNITS_AVX512)
+DATASET_GEN_AVX512_BEGIN
+
+// With 16 lanes and the Lehmer sequence, a step is a single vector. Lanes never hit the same unit, so the scatters do
+// not conflict.
+
+// Advances the Lehmer state of the lanes in mask.
+__m512i lehmer_next(__m512i state, __mmask16 mask) {
+  const __m512i multiplier = _mm512_set1_epi64(random_multiplier);
+  const __m512i modulus = _mm512_set1_epi64(random_modulus);
+  auto reduce = [&](__m512i product) {
+    product = _mm512_add_epi64(_mm512_and_si512(product, modulus), _mm512_srli_epi64(product, 31));
+    product = _mm512_add_epi64(_mm512_and_si512(product, modulus), _mm512_srli_epi64(product, 31));
+    return _mm512_mask_sub_epi64(product, _mm512_cmpge_epu64_mask(product, modulus), product, modulus);
+  };
+  const __m512i even = reduce(_mm512_mul_epu32(state, multiplier));
+  const __m512i odd = reduce(_mm512_mul_epu32(_mm512_srli_epi64(state, 32), multiplier));
+  const __m512i next = _mm512_mask_blend_epi32(0xaaaa, even, _mm512_slli_epi64(odd, 32));
+  return _mm512_mask_blend_epi32(mask, state, next);
+}
+
+// x % n for values below 2^31, given 1.0 / n. The quotient from the reciprocal is off by at most one and corrected.
+__m512i mod_lanes(__m512i x, __m512i n, __m512d inverse_lo, __m512d inverse_hi) {
+  auto quotient = [](__m256i x, __m512d inverse) {
+    return _mm512_cvttpd_epu32(_mm512_mul_pd(_mm512_cvtepu32_pd(x), inverse));
+  };
+  const __m256i lo = quotient(_mm512_castsi512_si256(x), inverse_lo);
+  const __m256i hi = quotient(_mm512_extracti64x4_epi64(x, 1), inverse_hi);
+  const __m512i q = _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+  __m512i rem = _mm512_sub_epi32(x, _mm512_mullo_epi32(q, n));
+  rem = _mm512_mask_add_epi32(rem, _mm512_cmplt_epi32_mask(rem, _mm512_setzero_si512()), rem, n);
+  return _mm512_mask_sub_epi32(rem, _mm512_cmpge_epi32_mask(rem, n), rem, n);
+}
+
+std::uint32_t fire_step_avx512(LaneBattle &battle, LaneState<LehmerFastRng, 16> &state) {
+  const __m512i lane_ids = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512 zero_ps = _mm512_setzero_ps();
+
+  __m512i shooters = _mm512_load_si512(state.shooters.data());
+  const __m512i shooters_end = _mm512_load_si512(state.shooters_end.data());
+  const __mmask16 busy = _mm512_cmplt_epu32_mask(shooters, shooters_end);
+
+  alignas(64) std::uint32_t rng_states[16];
+  for (std::uint32_t lane = 0; lane < 16; ++lane)
+    rng_states[lane] = state.rngs[lane].state;
+  __m512i r = lehmer_next(_mm512_load_si512(rng_states), busy);
+
+  const __m512i shooter = _mm512_add_epi32(_mm512_slli_epi32(shooters, 4), lane_ids);
+  const __m512i shooter_slot = _mm512_mask_i32gather_epi32(zero, busy, shooter, battle.slots.data(), 4);
+  const __m512i target_unit = _mm512_add_epi32(
+      _mm512_load_si512(state.target_offsets.data()),
+      mod_lanes(r, _mm512_load_si512(state.num_targets.data()), _mm512_load_pd(state.target_inverses.data()),
+                _mm512_load_pd(state.target_inverses.data() + 8)));
+  const __m512i target = _mm512_add_epi32(_mm512_slli_epi32(target_unit, 4), lane_ids);
+  const __m512i target_slot = _mm512_mask_i32gather_epi32(zero, busy, target, battle.slots.data(), 4);
+  const __m512i index =
+      _mm512_add_epi32(_mm512_mullo_epi32(shooter_slot, _mm512_set1_epi32(static_cast<int>(battle.num_slots))),
+                       target_slot);
+
+  const __m512 hull = _mm512_mask_i32gather_ps(zero_ps, busy, target, battle.hulls.data(), 4);
+  const __mmask16 alive = _mm512_mask_cmp_ps_mask(busy, hull, zero_ps, _CMP_NEQ_OQ);
+  const __m512 shield = _mm512_mask_i32gather_ps(zero_ps, alive, target, battle.shields.data(), 4);
+  const __m512 damage = _mm512_mask_i32gather_ps(zero_ps, alive, shooter_slot, battle.slot_damages.data(), 4);
+  __m512 hull_damage = _mm512_sub_ps(damage, shield);
+
+  const __mmask16 absorbed = _mm512_mask_cmp_ps_mask(alive, hull_damage, zero_ps, _CMP_LT_OQ);
+  const __m512 shield_damage = _mm512_mask_i32gather_ps(zero_ps, absorbed, index, battle.shield_damages.data(), 4);
+  const __m512 new_shield = _mm512_maskz_sub_ps(absorbed, shield, shield_damage);
+  hull_damage = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(hull_damage, hull, _CMP_GT_OQ), hull_damage, hull);
+  __m512 new_hull = _mm512_mask_sub_ps(hull, alive & ~absorbed, hull, hull_damage);
+
+  const __mmask16 damaged = _mm512_mask_cmp_ps_mask(alive, new_hull, zero_ps, _CMP_NEQ_OQ);
+  const __m512 explosion_hull =
+      _mm512_mask_i32gather_ps(zero_ps, damaged, target_slot, battle.slot_explosion_hulls.data(), 4);
+  const __mmask16 exploding = _mm512_mask_cmp_ps_mask(damaged, new_hull, explosion_hull, _CMP_LT_OQ);
+  r = lehmer_next(r, exploding);
+  const __m512 max_hull = _mm512_mask_i32gather_ps(zero_ps, exploding, target_slot, battle.slot_max_hulls.data(), 4);
+  const __m512 explosion_scale = _mm512_set1_ps(1.0f / static_cast<float>(LehmerFastRng::max));
+  const __m512 threshold = _mm512_mul_ps(_mm512_mul_ps(explosion_scale, _mm512_cvtepu32_ps(r)), max_hull);
+  new_hull =
+      _mm512_mask_mov_ps(new_hull, _mm512_mask_cmp_ps_mask(exploding, new_hull, threshold, _CMP_LT_OQ), zero_ps);
+
+  _mm512_mask_i32scatter_ps(battle.shields.data(), alive, target, new_shield, 4);
+  _mm512_mask_i32scatter_ps(battle.hulls.data(), alive, target, new_hull, 4);
+
+  const __m512i rapid_fire = _mm512_mask_i32gather_epi32(zero, busy, index, battle.rapid_fires.data(), 4);
+  const __mmask16 rapid = _mm512_mask_test_epi32_mask(busy, rapid_fire, rapid_fire);
+  const __m512d rapid_inverse_lo = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), static_cast<__mmask8>(rapid),
+                                                            _mm512_castsi512_si256(index),
+                                                            battle.rapid_fire_inverses.data(), 8);
+  const __m512d rapid_inverse_hi = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), static_cast<__mmask8>(rapid >> 8),
+                                                            _mm512_extracti64x4_epi64(index, 1),
+                                                            battle.rapid_fire_inverses.data(), 8);
+  r = lehmer_next(r, rapid);
+  const __m512i rapid_rem = mod_lanes(r, rapid_fire, rapid_inverse_lo, rapid_inverse_hi);
+  const __mmask16 again = _mm512_mask_test_epi32_mask(rapid, rapid_rem, rapid_rem);
+  shooters = _mm512_mask_add_epi32(shooters, busy & ~again, shooters, _mm512_set1_epi32(1));
+
+  _mm512_store_si512(state.shooters.data(), shooters);
+  _mm512_store_si512(rng_states, r);
+  for (std::uint32_t lane = 0; lane < 16; ++lane)
+    state.rngs[lane].state = rng_states[lane];
+
+  return _mm512_mask_cmpeq_epu32_mask(busy & ~again, shooters, shooters_end);
+}
+
+DATASET_GEN_AVX512_END
+#endif
+
+// Copies the units at the start of the battle into the lane.
+void load_lane(LaneBattle &battle, std::uint32_t lane) {
+  const std::uint32_t num_lanes = battle.num_lanes;
+  const std::uint32_t total_units = battle.num_units[0] + battle.num_units[1];
+  for (std::uint32_t i = 0; i < total_units; ++i) {
+    battle.shields[i * num_lanes + lane] = battle.initial_shields[i];
+    battle.hulls[i * num_lanes + lane] = battle.initial_hulls[i];
+    battle.slots[i * num_lanes + lane] = battle.initial_slots[i];
+  }
+}
+
+// update_units() for the units [begin, begin + num_alive) of the lane; returns the new number of alive units.
+std::uint32_t update_lane(LaneBattle &battle, std::uint32_t lane, std::uint32_t begin, std::uint32_t num_alive) {
+  const std::uint32_t num_lanes = battle.num_lanes;
+  float *shields = battle.shields.data();
+  float *hulls = battle.hulls.data();
+  std::uint32_t *slots = battle.slots.data();
+
+  std::uint32_t n = 0;
+  for (std::uint32_t i = 0; i < num_alive; ++i) {
+    const std::uint32_t from = (begin + i) * num_lanes + lane;
+    if (hulls[from] != 0.0f) {
+      const std::uint32_t to = (begin + n) * num_lanes + lane;
+      hulls[to] = hulls[from];
+      slots[to] = slots[from];
+      shields[to] = battle.slot_max_shields[slots[from]];
+      ++n;
+    }
+  }
+  return n;
+}
+
+// count_units() for the units [begin, begin + num_alive) of the lane.
+void count_lane_units(const LaneBattle &battle, std::uint32_t lane, std::uint32_t begin, std::uint32_t num_alive,
+                      std::span<UnitGroups<std::uint32_t>> unit_groups) {
+  for (auto &groups : unit_groups)
+    std::fill(groups.begin(), groups.end(), 0);
+
+  for (std::uint32_t i = 0; i < num_alive; ++i) {
+    const std::uint32_t slot = battle.slots[(begin + i) * battle.num_lanes + lane];
+    ++unit_groups[battle.slot_combatant_ids[slot]][battle.slot_kinds[slot]];
+  }
+}
+
+// Fights the replicas of the battle compiled into the workspace lane battle.
+template <typename Rng, std::uint32_t Lanes>
+void fight_lanes(BattleWorkspace &workspace, std::span<const std::uint32_t> seeds, std::span<BattleOutcome> outcomes) {
+  assert(outcomes.size() == seeds.size());
+  LaneBattle &battle = workspace.lanes;
+  const std::uint32_t unit_offsets[] = {0, battle.num_units[0]};
+
+  // All the engines of the Lehmer sequence step lanes as LehmerFastRng, which has a vectorized step.
+  using LaneRng = std::conditional_t<is_lehmer_sequence<Rng>, LehmerFastRng, Rng>;
+  LaneState<LaneRng, Lanes> state{};
+  std::size_t next_replica = 0;
+
+  auto start_side = [&](std::uint32_t lane, std::uint32_t side) {
+    state.sides[lane] = side;
+    state.shooters[lane] = unit_offsets[side];
+    state.shooters_end[lane] = unit_offsets[side] + state.num_alive[side][lane];
+    state.target_offsets[lane] = unit_offsets[1 - side];
+    state.num_targets[lane] = state.num_alive[1 - side][lane];
+    state.target_inverses[lane] = 1.0 / state.num_targets[lane];
+  };
+
+  auto finish_replica = [&](std::uint32_t lane) {
+    const BattleOutcome &outcome = outcomes[state.replicas[lane]];
+    count_lane_units(battle, lane, unit_offsets[0], state.num_alive[0][lane], outcome.attackers);
+    count_lane_units(battle, lane, unit_offsets[1], state.num_alive[1][lane], outcome.defenders);
+    outcomes[state.replicas[lane]].rounds = state.rounds[lane];
+  };
+
+  // Starts the next replica in the lane, or leaves the lane idle when there are no replicas left.
+  auto start_replica = [&](std::uint32_t lane) {
+    state.shooters[lane] = 0;
+    state.shooters_end[lane] = 0;
+    while (next_replica < seeds.size()) {
+      state.replicas[lane] = next_replica;
+      state.rngs[lane] = LaneRng{seeds[next_replica]};
+      state.num_alive[0][lane] = battle.num_units[0];
+      state.num_alive[1][lane] = battle.num_units[1];
+      state.rounds[lane] = 0;
+      ++next_replica;
+      load_lane(battle, lane);
+      if (battle.num_units[0] > 0 && battle.num_units[1] > 0) {
+        start_side(lane, 0);
+        return;
+      }
+      finish_replica(lane);
+    }
+  };
+
+  for (std::uint32_t lane = 0; lane < Lanes; ++lane)
+    start_replica(lane);
+
+  for (;;) {
+    std::uint32_t done;
+#if defined(DATASET_GEN_UNITS_AVX512)
+    if constexpr (Lanes == 16 && std::is_same_v<LaneRng, LehmerFastRng>)
+      done = fire_step_avx512(battle, state);
+    else
+#endif
+      done = fire_step(battle, state);
+
+    for (; done != 0; done &= done - 1) {
+      const auto lane = static_cast<std::uint32_t>(std::countr_zero(done));
+      if (state.sides[lane] == 0) {
+        start_side(lane, 1);
+        continue;
+      }
+
+      state.num_alive[0][lane] = update_lane(battle, lane, unit_offsets[0], state.num_alive[0][lane]);
+      state.num_alive[1][lane] = update_lane(battle, lane, unit_offsets[1], state.num_alive[1][lane]);
+      ++state.rounds[lane];
+      if (state.rounds[lane] < max_rounds && state.num_alive[0][lane] > 0 && state.num_alive[1][lane] > 0) {
+        start_side(lane, 0);
+      } else {
+        finish_replica(lane);
+        start_replica(lane);
+      }
+    }
+
+    bool any_busy = false;
+    for (std::uint32_t lane = 0; lane < Lanes; ++lane)
+      any_busy |= state.shooters[lane] != state.shooters_end[lane];
+    if (!any_busy)
+      break;
+  }
+}
+
+// Counted groups
+//
+// fight_groups() numbers the units like Party and fires with the same arithmetic and the same random numbers as
+// fire(), so a battle ends the same as with fight(). A target is found by its slot and, once hit, in the hash table of
+// the damaged units; the units never hit only exist as counts.
+//
+// Targets are uniformly random, so the low bits of a unit are a good enough hash. Once the table has a bucket per
+// alive unit, the bucket of a unit is the unit itself and the table is in order.
+
+// The bucket of the unit, or the empty bucket where it would be inserted if the unit was not hit.
+DamagedUnit &find_damaged(GroupParty &party, std::uint32_t unit) {
+  const std::size_t mask = party.buckets.size() - 1;
+  std::size_t bucket = unit & mask;
+  while (party.buckets[bucket].unit != unit + 1 && party.buckets[bucket].unit != 0)
+    bucket = (bucket + 1) & mask;
+  return party.buckets[bucket];
+}
+
+// Whether the table has a bucket per alive unit.
+bool is_direct(const GroupParty &party) { return party.buckets.size() >= party.slot_begins.back(); }
+
+// Sizes the hash table for num_units damaged units, at most half full or with a bucket per alive unit, and inserts the
+// ones of damaged. The table never shrinks during a battle, as the next round usually hits as many units.
+void fill_buckets(GroupParty &party, std::size_t num_units) {
+  const std::size_t num_buckets = std::bit_ceil(
+      std::min<std::size_t>(std::max<std::size_t>(16, 2 * num_units), std::max(party.slot_begins.back(), 1u)));
+  party.buckets.assign(std::max(num_buckets, party.buckets.size()), DamagedUnit{});
+  for (const DamagedUnit &unit : party.damaged)
+    find_damaged(party, unit.unit - 1) = unit;
+  party.num_damaged = static_cast<std::uint32_t>(party.damaged.size());
+}
+
+// Moves the damaged units from the hash table to damaged, in order.
+void collect_damaged(GroupParty &party) {
+  party.damaged.clear();
+  for (const DamagedUnit &unit : party.buckets) {
+    if (unit.unit != 0)
+      party.damaged.push_back(unit);
+  }
+  if (!is_direct(party))
+    std::ranges::sort(party.damaged, {}, &DamagedUnit::unit);
+}
+
+void count_slot_begins(GroupParty &party) {
+  party.slot_begins.resize(party.num_alive.size() + 1);
+  party.slot_begins[0] = 0;
+  std::partial_sum(party.num_alive.begin(), party.num_alive.end(), party.slot_begins.begin() + 1);
+}
+
+// Fills the groups with the units of the combatants of the party, whose slots were created by create_slots().
+void create_groups(const Party &party, GroupParty &groups) {
+  const std::size_t num_slots = party.slot_kinds.size();
+  groups.num_alive.resize(num_slots);
+  for (std::size_t slot = 0; slot < num_slots; ++slot)
+    groups.num_alive[slot] = party.combatants[party.slot_combatant_ids[slot]].unit_groups[party.slot_kinds[slot]];
+  count_slot_begins(groups);
+  groups.damaged.clear();
+  groups.buckets.clear();
+  fill_buckets(groups, 0);
+}
+
+template <typename Rng, typename Probe>
+void fire_groups(const Party &attackers_party, const GroupParty &attackers, const Party &defenders_party,
+                 GroupParty &defenders, const FireTable &table, Rng &rng, Probe &probe) {
+  std::uint32_t r;
+
+  const std::uint32_t *slot_begins = defenders.slot_begins.data();
+  const auto num_target_slots = static_cast<std::uint32_t>(defenders.num_alive.size());
+  const float *max_shields = defenders_party.slot_max_shields.data();
+  const float *max_hulls = defenders_party.slot_max_hulls.data();
+  const float *explosion_hulls = defenders_party.slot_explosion_hulls.data();
+  const std::uint32_t num_targets = slot_begins[num_target_slots];
+
+  for (std::uint32_t shooter_slot = 0; shooter_slot < attackers.num_alive.size(); ++shooter_slot) {
+    const float damage = attackers_party.slot_damages[shooter_slot];
+    const float *shield_damages = &table.shield_damages[shooter_slot * table.num_target_slots];
+    const std::uint32_t *rapid_fires = &table.rapid_fires[shooter_slot * table.num_target_slots];
+    const std::uint8_t shooter_kind = attackers_party.slot_kinds[shooter_slot];
+    std::uint32_t rapid_fire;
+
+    for (std::uint32_t i = 0; i < attackers.num_alive[shooter_slot]; ++i) {
+      probe.shooter(shooter_kind);
+      do {
+        probe.shot(shooter_kind);
+        r = rng.next();
+        const std::uint32_t target = r % num_targets;
+        const auto target_slot = static_cast<std::uint32_t>(
+            std::upper_bound(slot_begins + 1, slot_begins + num_target_slots, target) - (slot_begins + 1));
+
+        DamagedUnit &unit = find_damaged(defenders, target);
+        float shield = max_shields[target_slot];
+        float hull = max_hulls[target_slot];
+        if (unit.unit != 0) {
+          shield = unit.shield;
+          hull = unit.hull;
+        }
+
         if (hull != 0.0f) {
-          const float max_hull = 0.1f * target_attrs.armor * (1.0f + 0.1f * defender.techs.armor);
-          if (hull < 0.7f * max_hull) {
-            r = random_next(r);
-            if (hull < (1.0f / static_cast<float>(random_max)) * static_cast<float>(r) * max_hull)
+          float hull_damage = damage - shield;
+
+          if (hull_damage < 0.0f) {
+            probe.shield_bounce();
+            shield -= shield_damages[target_slot];
+          } else {
+            shield = 0.0f;
+            if (hull_damage > hull)
+              hull_damage = hull;
+            hull -= hull_damage;
+          }
+
+          if (hull != 0.0f && hull < explosion_hulls[target_slot]) {
+            probe.explosion_roll();
+            r = rng.next();
+            if (hull < (1.0f / static_cast<float>(Rng::max)) * static_cast<float>(r) * max_hulls[target_slot]) {
+              probe.explosion_kill();
               hull = 0.0f;
+            }
+          }
+
+          if (unit.unit != 0) {
+            unit.shield = shield;
+            unit.hull = hull;
+          } else if (shield != max_shields[target_slot] || hull != max_hulls[target_slot]) {
+            unit = {target + 1, target_slot, shield, hull};
+            if (2 * ++defenders.num_damaged > defenders.buckets.size() && !is_direct(defenders)) {
+              collect_damaged(defenders);
+              fill_buckets(defenders, 2 * defenders.damaged.size());
+            }
+          }
+        } else {
+          probe.dead_target_hit();
+        }
+
+        rapid_fire = rapid_fires[target_slot];
+      } while (rapid_fire != 0 && (r = rng.next()) % rapid_fire != 0);
+    }
+  }
+}
+
+// update_units() for the groups: drops the destroyed units and renumbers the others, and restores the shields. A unit
+// whose hull was not damaged is as at the start of the battle again and goes back to the counts.
+void update_groups(const Party &party, GroupParty &groups) {
+  collect_damaged(groups);
+
+  std::uint32_t num_destroyed = 0;
+  std::size_t n = 0;
+  for (DamagedUnit unit : groups.damaged) {
+    if (unit.hull == 0.0f) {
+      ++num_destroyed;
+      --groups.num_alive[unit.slot];
+      continue;
+    }
+    if (unit.hull == party.slot_max_hulls[unit.slot])
+      continue;
+    unit.unit -= num_destroyed;
+    unit.shield = party.slot_max_shields[unit.slot];
+    groups.damaged[n++] = unit;
+  }
+  groups.damaged.resize(n);
+
+  // Units without hull are destroyed by the first update, like in update_units().
+  for (std::size_t slot = 0; slot < groups.num_alive.size(); ++slot) {
+    if (party.slot_max_hulls[slot] == 0.0f)
+      groups.num_alive[slot] = 0;
+  }
+
+  count_slot_begins(groups);
+  fill_buckets(groups, n);
+}
+
+// count_units() for the groups.
+void count_groups(const Party &party, const GroupParty &groups, std::span<UnitGroups<std::uint32_t>> unit_groups) {
+  assert(unit_groups.size() == party.combatants.size());
+  for (auto &groups_of_combatant : unit_groups)
+    std::fill(groups_of_combatant.begin(), groups_of_combatant.end(), 0);
+  for (std::size_t slot = 0; slot < groups.num_alive.size(); ++slot)
+    unit_groups[party.slot_combatant_ids[slot]][party.slot_kinds[slot]] = groups.num_alive[slot];
+}
+
+template <typename Rng, typename Probe>
+std::uint32_t fight_with(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                         const BattleOutcome &outcome, Probe &probe) {
+  Party &attackers_party = workspace.attackers;
+  Party &defenders_party = workspace.defenders;
+  create_party(attackers_party, spec.attackers);
+  create_party(defenders_party, spec.defenders);
+
+  compile_fire_table(attackers_party, defenders_party, workspace.attackers_table);
+  compile_fire_table(defenders_party, attackers_party, workspace.defenders_table);
+  probe.end_phase(BattlePhase::CreateParty);
+
+  Rng rng{seed};
+  std::uint32_t round = 0;
+
+  // Shields are restored by create_party before the first round and by update_units before the next ones.
+  while (round < max_rounds && attackers_party.num_alive > 0 && defenders_party.num_alive > 0) {
+    fire(attackers_party, defenders_party, workspace.attackers_table, rng, probe);
+    fire(defenders_party, attackers_party, workspace.defenders_table, rng, probe);
+    probe.end_phase(BattlePhase::Fire);
+
+    update_units(attackers_party);
+    update_units(defenders_party);
+    probe.end_phase(BattlePhase::UpdateUnits);
+
+    ++round;
+  }
+
+  count_units(attackers_party, outcome.attackers);
+  count_units(defenders_party, outcome.defenders);
+  probe.end_phase(BattlePhase::CountUnits);
+  probe.end_battle(round);
+
+  return round;
+}
+
+// Compact units
+//
+// fight_compact() keeps the fire() rules on CompactParty. A bounce takes the same whole percents off a shield as in
+// fire(), so shields stay whole percents of the max shield; a hull loses the damage rounded to a thousandth of a point,
+// fine enough to keep the slivers small shots leave under the explosion threshold. The units are kept in the order of
+// Party, so a random number picks the same target in both.
+
+constexpr std::uint8_t full_shield_percents = 100;
+// Thousandths of a point of hull damage that are taken as a whole thousandth, for the float error of damages and
+// shields.
+constexpr float hull_damage_tolerance = 0.01f;
+
+// Fills compact with the units of the party, whose slots were created by create_slots().
+void create_compact(const Party &party, CompactParty &compact) {
+  const std::size_t num_slots = party.slot_kinds.size();
+  compact.slot_shield_steps.resize(num_slots);
+  compact.slot_max_hulls.resize(num_slots);
+  compact.slot_explosion_hulls.resize(num_slots);
+  std::uint32_t num_units = 0;
+  for (std::size_t slot = 0; slot < num_slots; ++slot) {
+    compact.slot_shield_steps[slot] = 0.01f * party.slot_max_shields[slot];
+    compact.slot_max_hulls[slot] = std::round(1000.0f * party.slot_max_hulls[slot]);
+    compact.slot_explosion_hulls[slot] = 1000.0f * party.slot_explosion_hulls[slot];
+    // The largest hull, a death star with 255 armour technology, takes 2.4e9 thousandths.
+    assert(compact.slot_max_hulls[slot] <= static_cast<float>(std::numeric_limits<std::uint32_t>::max()));
+    num_units += party.combatants[party.slot_combatant_ids[slot]].unit_groups[party.slot_kinds[slot]];
+  }
+
+  compact.units.resize(num_units);
+
+  // Slots are numbered in the order of the units of Party.
+  std::uint32_t n = 0;
+  for (std::size_t slot = 0; slot < num_slots; ++slot) {
+    const std::uint32_t end = n + party.combatants[party.slot_combatant_ids[slot]].unit_groups[party.slot_kinds[slot]];
+    const CompactUnit unit{.hull = static_cast<std::uint32_t>(compact.slot_max_hulls[slot]),
+                           .slot = static_cast<std::uint16_t>(slot),
+                           .shield_percents = full_shield_percents};
+    std::fill(compact.units.data() + n, compact.units.data() + end, unit);
+    n = end;
+  }
+  compact.num_alive = num_units;
+}
+
+template <typename Rng, typename Probe>
+void fire_compact(const Party &attackers_party, const CompactParty &attackers, CompactParty &defenders,
+                  const FireTable &table, Rng &rng, Probe &probe) {
+  std::uint32_t r;
+
+  const CompactUnit *shooters = attackers.units.data();
+  const std::uint32_t num_shooters = attackers.num_alive;
+
+  CompactUnit *targets = defenders.units.data();
+  const float *shield_steps = defenders.slot_shield_steps.data();
+  const float *max_hulls = defenders.slot_max_hulls.data();
+  const float *explosion_hulls = defenders.slot_explosion_hulls.data();
+  const std::uint32_t num_targets = defenders.num_alive;
+
+  for (std::uint32_t i = 0; i < num_shooters; ++i) {
+    const std::uint32_t shooter_slot = shooters[i].slot;
+    const std::uint8_t shooter_kind = attackers_party.slot_kinds[shooter_slot];
+    const float damage = attackers_party.slot_damages[shooter_slot];
+    const std::uint8_t *shield_percents = &table.shield_percents[shooter_slot * table.num_target_slots];
+    const std::uint32_t *rapid_fires = &table.rapid_fires[shooter_slot * table.num_target_slots];
+    std::uint32_t rapid_fire;
+    probe.shooter(shooter_kind);
+
+    do {
+      probe.shot(shooter_kind);
+      r = rng.next();
+      CompactUnit &target = targets[r % num_targets];
+      const std::uint32_t target_slot = target.slot;
+
+      if (target.hull != 0) {
+        std::uint32_t hull = target.hull;
+        const std::uint8_t shield = target.shield_percents;
+
+        // damage < shield, compared in whole percents of the max shield, as shields only lose whole percents.
+        if (shield_percents[target_slot] < shield) {
+          probe.shield_bounce();
+          target.shield_percents = static_cast<std::uint8_t>(shield - shield_percents[target_slot]);
+        } else {
+          target.shield_percents = 0;
+          const float hull_damage = damage - static_cast<float>(shield) * shield_steps[target_slot];
+          const float thousandths = std::max(std::floor(1000.0f * hull_damage + hull_damage_tolerance), 0.0f);
+          hull = thousandths >= static_cast<float>(hull) ? 0 : hull - static_cast<std::uint32_t>(thousandths);
+        }
+
+        if (hull != 0 && static_cast<float>(hull) < explosion_hulls[target_slot]) {
+          probe.explosion_roll();
+          r = rng.next();
+          if (static_cast<float>(hull) <
+              (1.0f / static_cast<float>(Rng::max)) * static_cast<float>(r) * max_hulls[target_slot]) {
+            probe.explosion_kill();
+            hull = 0;
           }
         }
         target.hull = hull;
+      } else {
+        probe.dead_target_hit();
       }
 
-      rapid_fire = shooter_attrs.rapid_fire[target.kind];
-    } while (rapid_fire != 0 && (r = random_next(r)) % rapid_fire != 0);
+      rapid_fire = rapid_fires[target_slot];
+    } while (rapid_fire != 0 && (r = rng.next()) % rapid_fire != 0);
   }
-
-  random = r;
 }
 
-void update_units(Party &party) {
-  Unit *units = party.units.data();
+// update_units() for CompactParty.
+void update_compact(CompactParty &party) {
+  CompactUnit *units = party.units.data();
+
   std::uint32_t n = 0;
   for (std::uint32_t i = 0; i < party.num_alive; ++i) {
-    if (units[i].hull != 0.0f)
-      units[n++] = units[i];
+    if (units[i].hull != 0) {
+      units[n] = units[i];
+      units[n].shield_percents = full_shield_percents;
+      ++n;
+    }
   }
   party.num_alive = n;
 }
 
-void update_combatants(Party &party) {
-  for (auto &combatant : party.combatants)
-    std::fill(combatant.unit_groups.begin(), combatant.unit_groups.end(), 0);
+// count_units() for CompactParty.
+void count_compact(const Party &party, const CompactParty &compact, std::span<UnitGroups<std::uint32_t>> unit_groups) {
+  assert(unit_groups.size() == party.combatants.size());
+  for (auto &groups : unit_groups)
+    std::fill(groups.begin(), groups.end(), 0);
 
-  for (std::uint32_t i = 0; i < party.num_alive; ++i) {
-    const Unit &unit = party.units[i];
-    ++party.combatants[unit.combatant_id].unit_groups[unit.kind];
+  for (std::uint32_t i = 0; i < compact.num_alive; ++i) {
+    const std::uint16_t slot = compact.units[i].slot;
+    ++unit_groups[party.slot_combatant_ids[slot]][party.slot_kinds[slot]];
+  }
+}
+
+// Parallel fire
+//
+// A round of fire_parallel() has two passes over the pool. First, chunks of shooters draw their shots with their own
+// random numbers. A target only decides the rapid fire through its kind, which does not change during the round, so no
+// chunk needs the hits of the others; the shots are recorded, bucketed by range of targets. Then every range of targets
+// applies the shots at it, chunk after chunk, with the arithmetic of fire() and its own random numbers for the
+// explosions. A target is only written by the thread of its range, and receives its hits in the order fire() would
+// apply them. Chunks and ranges have fixed sizes, so the random numbers do not depend on the number of threads.
+
+constexpr std::uint32_t parallel_fire_min_part = 32768;
+constexpr std::uint32_t parallel_fire_max_parts = 64;
+
+std::uint32_t parallel_fire_parts(std::uint32_t num_units) {
+  return std::clamp((num_units + parallel_fire_min_part - 1) / parallel_fire_min_part, 1u, parallel_fire_max_parts);
+}
+
+// Seed of a stream of random numbers of the battle: a valid seed of every engine (Lehmer needs [1, 2^31 - 2]).
+std::uint32_t stream_seed(std::uint32_t battle_seed, std::uint64_t stream) {
+  RowRng rng{battle_seed, stream};
+  return 1 + static_cast<std::uint32_t>(rng() % (random_modulus - 1));
+}
+
+// Draws the shots of the shooters [begin, end) of attackers_party at defenders_party with the random numbers of fire(),
+// but for the explosions, and passes every one to record(target, shooter_slot) in the order they are fired.
+template <typename Rng, typename Probe, typename Record>
+void draw_shots(const Party &attackers_party, const Party &defenders_party, const FireTable &table, std::uint32_t begin,
+                std::uint32_t end, Rng &rng, Probe &probe, Record &&record) {
+  const std::uint8_t *shooter_kinds = attackers_party.kinds.data();
+  const std::uint8_t *shooter_combatant_ids = attackers_party.combatant_ids.data();
+  const std::uint16_t *shooter_slots = attackers_party.slots.data();
+
+  const std::uint8_t *target_kinds = defenders_party.kinds.data();
+  const std::uint8_t *target_combatant_ids = defenders_party.combatant_ids.data();
+  const std::uint16_t *target_slots = defenders_party.slots.data();
+  const std::uint32_t num_targets = defenders_party.num_alive;
+
+  for (std::uint32_t i = begin; i < end; ++i) {
+    const std::uint32_t shooter_slot = shooter_slots[slot_of(shooter_combatant_ids[i], shooter_kinds[i])];
+    const std::uint32_t *rapid_fires = &table.rapid_fires[shooter_slot * table.num_target_slots];
+    std::uint32_t rapid_fire;
+    probe.shooter(shooter_kinds[i]);
+    do {
+      probe.shot(shooter_kinds[i]);
+      const std::uint32_t target = rng.next() % num_targets;
+      const std::uint32_t target_slot = target_slots[slot_of(target_combatant_ids[target], target_kinds[target])];
+      record(target, shooter_slot);
+      rapid_fire = rapid_fires[target_slot];
+    } while (rapid_fire != 0 && rng.next() % rapid_fire != 0);
+  }
+}
+
+// Applies the shots, each a target index << 16 | shooter slot, in order with the arithmetic of fire(), drawing the
+// explosions from rng.
+template <typename Rng, typename Probe>
+void apply_shots(const Party &attackers_party, Party &defenders_party, const FireTable &table,
+                 std::span<const std::uint64_t> shots, Rng &rng, Probe &probe) {
+  float *target_shields = defenders_party.shields.data();
+  float *target_hulls = defenders_party.hulls.data();
+  const std::uint8_t *target_kinds = defenders_party.kinds.data();
+  const std::uint8_t *target_combatant_ids = defenders_party.combatant_ids.data();
+  const std::uint16_t *target_slots = defenders_party.slots.data();
+  const float *max_hulls = defenders_party.slot_max_hulls.data();
+  const float *explosion_hulls = defenders_party.slot_explosion_hulls.data();
+
+  for (const std::uint64_t shot : shots) {
+    const auto target = static_cast<std::uint32_t>(shot >> 16);
+    const auto shooter_slot = static_cast<std::uint32_t>(shot & 0xffff);
+    if (target_hulls[target] == 0.0f) {
+      probe.dead_target_hit();
+      continue;
+    }
+
+    const std::uint32_t target_slot = target_slots[slot_of(target_combatant_ids[target], target_kinds[target])];
+    float hull = target_hulls[target];
+    float hull_damage = attackers_party.slot_damages[shooter_slot] - target_shields[target];
+    if (hull_damage < 0.0f) {
+      probe.shield_bounce();
+      target_shields[target] -= table.shield_damages[shooter_slot * table.num_target_slots + target_slot];
+    } else {
+      target_shields[target] = 0.0f;
+      if (hull_damage > hull)
+        hull_damage = hull;
+      hull -= hull_damage;
+    }
+
+    if (hull != 0.0f && hull < explosion_hulls[target_slot]) {
+      probe.explosion_roll();
+      const std::uint32_t r = rng.next();
+      if (hull < (1.0f / static_cast<float>(Rng::max)) * static_cast<float>(r) * max_hulls[target_slot]) {
+        probe.explosion_kill();
+        hull = 0.0f;
+      }
+    }
+    target_hulls[target] = hull;
+  }
+}
+
+// Fires the shots of attackers_party at defenders_party; stream numbers the random number streams of the call.
+template <typename Rng>
+void fire_parallel(const Party &attackers_party, Party &defenders_party, const FireTable &table,
+                   std::uint32_t battle_seed, std::uint64_t stream, ParallelFire &parallel, ThreadPool &pool) {
+  const std::uint32_t num_shooters = attackers_party.num_alive;
+  const std::uint32_t num_targets = defenders_party.num_alive;
+  const std::uint32_t num_chunks = parallel_fire_parts(num_shooters);
+  const std::uint32_t num_ranges = parallel_fire_parts(num_targets);
+  const std::uint32_t chunk_size = (num_shooters + num_chunks - 1) / num_chunks;
+  const std::uint32_t range_size = (num_targets + num_ranges - 1) / num_ranges;
+  parallel.num_ranges = num_ranges;
+  if (parallel.buckets.size() < num_chunks * num_ranges)
+    parallel.buckets.resize(num_chunks * num_ranges);
+
+  pool.run(num_chunks, [&](std::uint32_t /*thread*/, std::size_t chunk) {
+    std::vector<std::uint64_t> *buckets = &parallel.buckets[chunk * num_ranges];
+    for (std::uint32_t range = 0; range < num_ranges; ++range)
+      buckets[range].clear();
+
+    Rng rng{stream_seed(battle_seed, stream << 8 | chunk)};
+    NoProbe probe;
+    const auto begin = static_cast<std::uint32_t>(chunk) * chunk_size;
+    const std::uint32_t end = std::min(begin + chunk_size, num_shooters);
+    draw_shots(attackers_party, defenders_party, table, begin, end, rng, probe,
+               [&](std::uint32_t target, std::uint32_t shooter_slot) {
+                 buckets[target / range_size].push_back(std::uint64_t{target} << 16 | shooter_slot);
+               });
+  });
+
+  pool.run(num_ranges, [&](std::uint32_t /*thread*/, std::size_t range) {
+    Rng rng{stream_seed(battle_seed, stream << 8 | parallel_fire_max_parts | range)};
+    NoProbe probe;
+    for (std::uint32_t chunk = 0; chunk < num_chunks; ++chunk)
+      apply_shots(attackers_party, defenders_party, table, parallel.buckets[chunk * num_ranges + range], rng, probe);
+  });
+}
+
+// Hit batching
+//
+// fire_batched() is fire_parallel() on one thread with a single stream of random numbers: the shots of a batch of
+// shooters are drawn first, sorted by block of targets with a counting sort that keeps the order they were fired in,
+// then applied block after block. The hits of a block land on hit_batch_block targets that stay in the caches, instead
+// of a random unit of the whole party for every shot.
+
+// 16384 targets, 160 KiB of Party.
+constexpr std::uint32_t hit_batch_block_shift = 14;
+// Shooters of a batch, which bounds the memory of the shots of a round.
+constexpr std::uint32_t hit_batch_max_shooters = 1u << 22;
+
+template <typename Rng, typename Probe>
+void fire_batched(const Party &attackers_party, Party &defenders_party, const FireTable &table, HitBatches &batches,
+                  Rng &rng, Probe &probe) {
+  const std::uint32_t num_shooters = attackers_party.num_alive;
+  const std::uint32_t num_blocks = ((defenders_party.num_alive - 1) >> hit_batch_block_shift) + 1;
+  std::vector<std::uint64_t> &shots = batches.shots;
+  std::vector<std::uint64_t> &sorted = batches.sorted;
+  std::vector<std::uint32_t> &block_begins = batches.block_begins;
+
+  for (std::uint32_t begin = 0; begin < num_shooters; begin += hit_batch_max_shooters) {
+    const std::uint32_t end = std::min(begin + hit_batch_max_shooters, num_shooters);
+    shots.clear();
+    draw_shots(attackers_party, defenders_party, table, begin, end, rng, probe,
+               [&](std::uint32_t target, std::uint32_t shooter_slot) {
+                 shots.push_back(std::uint64_t{target} << 16 | shooter_slot);
+               });
+    if (num_blocks == 1) {
+      apply_shots(attackers_party, defenders_party, table, shots, rng, probe);
+      continue;
+    }
+
+    block_begins.assign(num_blocks, 0);
+    for (const std::uint64_t shot : shots)
+      ++block_begins[shot >> (16 + hit_batch_block_shift)];
+    std::exclusive_scan(block_begins.begin(), block_begins.end(), block_begins.begin(), 0u);
+    sorted.resize(shots.size());
+    for (const std::uint64_t shot : shots)
+      sorted[block_begins[shot >> (16 + hit_batch_block_shift)]++] = shot;
+    apply_shots(attackers_party, defenders_party, table, sorted, rng, probe);
   }
 }
 
 } // namespace
 
-std::uint32_t fight(std::vector<Combatant> &attackers, std::vector<Combatant> &defenders, std::uint32_t seed) {
-  Party attackers_party = create_party(attackers);
-  Party defenders_party = create_party(defenders);
+void EngineStats::merge(const EngineStats &other) {
+  battles += other.battles;
+  shooters = shooters + other.shooters;
+  shots = shots + other.shots;
+  dead_target_hits += other.dead_target_hits;
+  shield_bounces += other.shield_bounces;
+  explosion_rolls += other.explosion_rolls;
+  explosion_kills += other.explosion_kills;
+  for (std::size_t i = 0; i < rounds.size(); ++i)
+    rounds[i] += other.rounds[i];
+  for (std::size_t i = 0; i < phase_ticks.size(); ++i)
+    phase_ticks[i] += other.phase_ticks[i];
+}
+
+template <typename Rng>
+std::uint32_t fight(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                    const BattleOutcome &outcome) {
+  FightProbe probe{workspace.stats};
+  return fight_with<Rng>(workspace, spec, seed, outcome, probe);
+}
+
+template <typename Rng>
+std::uint32_t fight_timed(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                          const BattleOutcome &outcome, PhaseTimes &times) {
+  PhaseProbe probe{times};
+  return fight_with<Rng>(workspace, spec, seed, outcome, probe);
+}
+
+template <typename Rng>
+std::uint32_t fight_groups(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                           const BattleOutcome &outcome) {
+  FightProbe probe{workspace.stats};
+  Party &attackers_party = workspace.attackers;
+  Party &defenders_party = workspace.defenders;
+  GroupParty &attackers = workspace.attacker_groups;
+  GroupParty &defenders = workspace.defender_groups;
+  create_slots(attackers_party, spec.attackers);
+  create_slots(defenders_party, spec.defenders);
+  create_groups(attackers_party, attackers);
+  create_groups(defenders_party, defenders);
+
+  compile_fire_table(attackers_party, defenders_party, workspace.attackers_table);
+  compile_fire_table(defenders_party, attackers_party, workspace.defenders_table);
+  probe.end_phase(BattlePhase::CreateParty);
 
-  constexpr std::uint32_t max_rounds = 6;
+  Rng rng{seed};
   std::uint32_t round = 0;
 
+  while (round < max_rounds && attackers.slot_begins.back() > 0 && defenders.slot_begins.back() > 0) {
+    fire_groups(attackers_party, attackers, defenders_party, defenders, workspace.attackers_table, rng, probe);
+    fire_groups(defenders_party, defenders, attackers_party, attackers, workspace.defenders_table, rng, probe);
+    probe.end_phase(BattlePhase::Fire);
+
+    update_groups(attackers_party, attackers);
+    update_groups(defenders_party, defenders);
+    probe.end_phase(BattlePhase::UpdateUnits);
+
+    ++round;
+  }
+
+  count_groups(attackers_party, attackers, outcome.attackers);
+  count_groups(defenders_party, defenders, outcome.defenders);
+  probe.end_phase(BattlePhase::CountUnits);
+  probe.end_battle(round);
+
+  return round;
+}
+
+template <typename Rng>
+std::uint32_t fight_compact(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                            const BattleOutcome &outcome) {
+  FightProbe probe{workspace.stats};
+  Party &attackers_party = workspace.attackers;
+  Party &defenders_party = workspace.defenders;
+  CompactParty &attackers = workspace.compact_attackers;
+  CompactParty &defenders = workspace.compact_defenders;
+  create_slots(attackers_party, spec.attackers);
+  create_slots(defenders_party, spec.defenders);
+  create_compact(attackers_party, attackers);
+  create_compact(defenders_party, defenders);
+
+  compile_fire_table(attackers_party, defenders_party, workspace.attackers_table);
+  compile_fire_table(defenders_party, attackers_party, workspace.defenders_table);
+  probe.end_phase(BattlePhase::CreateParty);
+
+  Rng rng{seed};
+  std::uint32_t round = 0;
+
+  while (round < max_rounds && attackers.num_alive > 0 && defenders.num_alive > 0) {
+    fire_compact(attackers_party, attackers, defenders, workspace.attackers_table, rng, probe);
+    fire_compact(defenders_party, defenders, attackers, workspace.defenders_table, rng, probe);
+    probe.end_phase(BattlePhase::Fire);
+
+    update_compact(attackers);
+    update_compact(defenders);
+    probe.end_phase(BattlePhase::UpdateUnits);
+
+    ++round;
+  }
+
+  count_compact(attackers_party, attackers, outcome.attackers);
+  count_compact(defenders_party, defenders, outcome.defenders);
+  probe.end_phase(BattlePhase::CountUnits);
+  probe.end_battle(round);
+
+  return round;
+}
+
+template <typename Rng>
+std::uint32_t fight_parallel(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                             const BattleOutcome &outcome, ThreadPool &pool) {
+  Party &attackers_party = workspace.attackers;
+  Party &defenders_party = workspace.defenders;
+  create_party(attackers_party, spec.attackers);
+  create_party(defenders_party, spec.defenders);
+
+  compile_fire_table(attackers_party, defenders_party, workspace.attackers_table);
+  compile_fire_table(defenders_party, attackers_party, workspace.defenders_table);
+
+  std::uint32_t round = 0;
   while (round < max_rounds && attackers_party.num_alive > 0 && defenders_party.num_alive > 0) {
-    restore_shields(attackers_party);
-    restore_shields(defenders_party);
+    fire_parallel<Rng>(attackers_party, defenders_party, workspace.attackers_table, seed, 2 * round,
+                       workspace.parallel_fire, pool);
+    fire_parallel<Rng>(defenders_party, attackers_party, workspace.defenders_table, seed, 2 * round + 1,
+                       workspace.parallel_fire, pool);
+
+    update_units(attackers_party);
+    update_units(defenders_party);
 
-    fire(attackers_party, defenders_party, seed);
-    fire(defenders_party, attackers_party, seed);
+    ++round;
+  }
+
+  count_units(attackers_party, outcome.attackers);
+  count_units(defenders_party, outcome.defenders);
+
+  return round;
+}
+
+template <typename Rng>
+std::uint32_t fight_batched(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                            const BattleOutcome &outcome) {
+  FightProbe probe{workspace.stats};
+  Party &attackers_party = workspace.attackers;
+  Party &defenders_party = workspace.defenders;
+  create_party(attackers_party, spec.attackers);
+  create_party(defenders_party, spec.defenders);
+
+  compile_fire_table(attackers_party, defenders_party, workspace.attackers_table);
+  compile_fire_table(defenders_party, attackers_party, workspace.defenders_table);
+  probe.end_phase(BattlePhase::CreateParty);
+
+  Rng rng{seed};
+  std::uint32_t round = 0;
+
+  while (round < max_rounds && attackers_party.num_alive > 0 && defenders_party.num_alive > 0) {
+    fire_batched(attackers_party, defenders_party, workspace.attackers_table, workspace.hit_batches, rng, probe);
+    fire_batched(defenders_party, attackers_party, workspace.defenders_table, workspace.hit_batches, rng, probe);
+    probe.end_phase(BattlePhase::Fire);
 
     update_units(attackers_party);
     update_units(defenders_party);
+    probe.end_phase(BattlePhase::UpdateUnits);
 
     ++round;
   }
 
-  update_combatants(attackers_party);
-  update_combatants(defenders_party);
+  count_units(attackers_party, outcome.attackers);
+  count_units(defenders_party, outcome.defenders);
+  probe.end_phase(BattlePhase::CountUnits);
+  probe.end_battle(round);
 
   return round;
 }
 
+bool is_trivial_battle(const BattleSpec &spec) {
+  return !has_units(spec.attackers) || !has_units(spec.defenders) ||
+         (is_harmless(spec.attackers, spec.defenders) && is_harmless(spec.defenders, spec.attackers));
+}
+
+void fight_many(BattleWorkspace &workspace, std::span<const BattleSpec> specs, std::span<const std::uint32_t> seeds,
+                std::span<BattleOutcome> outcomes, RngKind rng) {
+  assert(seeds.size() == specs.size() && outcomes.size() == specs.size());
+  with_rng(rng, [&]<typename Rng>(std::type_identity<Rng>) {
+    for (std::size_t i = 0; i < specs.size(); ++i)
+      outcomes[i].rounds = fight<Rng>(workspace, specs[i], seeds[i], outcomes[i]);
+  });
+}
+
+void fight_replicas(BattleWorkspace &workspace, const BattleSpec &spec, std::span<const std::uint32_t> seeds,
+                    std::span<BattleOutcome> outcomes, const FightOptions &options) {
+  assert(outcomes.size() == seeds.size());
+  with_rng(options.rng, [&]<typename Rng>(std::type_identity<Rng>) {
+    if (options.pool != nullptr) {
+      for (std::size_t i = 0; i < seeds.size(); ++i)
+        outcomes[i].rounds = fight_parallel<Rng>(workspace, spec, seeds[i], outcomes[i], *options.pool);
+      return;
+    }
+
+    if (options.engine == EngineKind::Groups) {
+      for (std::size_t i = 0; i < seeds.size(); ++i)
+        outcomes[i].rounds = fight_groups<Rng>(workspace, spec, seeds[i], outcomes[i]);
+      return;
+    }
+    if (options.engine == EngineKind::Compact) {
+      for (std::size_t i = 0; i < seeds.size(); ++i)
+        outcomes[i].rounds = fight_compact<Rng>(workspace, spec, seeds[i], outcomes[i]);
+      return;
+    }
+    if (options.engine == EngineKind::Batched) {
+      for (std::size_t i = 0; i < seeds.size(); ++i)
+        outcomes[i].rounds = fight_batched<Rng>(workspace, spec, seeds[i], outcomes[i]);
+      return;
+    }
+
+    std::uint32_t lanes = options.lanes;
+    // Lanes without a replica to fight would only slow down the others.
+    if (lanes == 0)
+      lanes = seeds.size() >= default_lanes<Rng> ? default_lanes<Rng> : 1;
+    // The lanes have no probes; with stats every replica is fought by fight().
+    if (engine_stats_enabled)
+      lanes = 1;
+
+    std::uint32_t num_units = 0;
+    for (const auto *combatants : {&spec.attackers, &spec.defenders}) {
+      for (const auto &combatant : *combatants)
+        num_units += std::accumulate(combatant.unit_groups.cbegin(), combatant.unit_groups.cend(), std::uint32_t{0});
+    }
+    if (std::uint64_t{num_units} * lanes * lane_unit_size > lane_footprint_limit)
+      lanes = 1;
+
+    auto fight_all = [&]<std::uint32_t Lanes>(std::integral_constant<std::uint32_t, Lanes>) {
+      create_party(workspace.attackers, spec.attackers);
+      create_party(workspace.defenders, spec.defenders);
+      compile_fire_table(workspace.attackers, workspace.defenders, workspace.attackers_table);
+      compile_fire_table(workspace.defenders, workspace.attackers, workspace.defenders_table);
+      compile_lane_battle(workspace, Lanes);
+      fight_lanes<Rng, Lanes>(workspace, seeds, outcomes);
+    };
+
+    switch (lanes) {
+    case 8:
+      fight_all(std::integral_constant<std::uint32_t, 8>{});
+      break;
+    case 16:
+      fight_all(std::integral_constant<std::uint32_t, 16>{});
+      break;
+    default:
+      assert(lanes == 1);
+      for (std::size_t i = 0; i < seeds.size(); ++i)
+        outcomes[i].rounds = fight<Rng>(workspace, spec, seeds[i], outcomes[i]);
+      break;
+    }
+  });
+}
+
+template std::uint32_t fight<LehmerRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t, const BattleOutcome &);
+template std::uint32_t fight<LehmerFastRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                            const BattleOutcome &);
+template std::uint32_t fight<BlockRng<LehmerFastRng>>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                      const BattleOutcome &);
+template std::uint32_t fight<Xoshiro128PlusRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                const BattleOutcome &);
+template std::uint32_t fight<Pcg32Rng>(BattleWorkspace &, const BattleSpec &, std::uint32_t, const BattleOutcome &);
+
+template std::uint32_t fight_timed<LehmerRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                              const BattleOutcome &, PhaseTimes &);
+template std::uint32_t fight_timed<LehmerFastRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                  const BattleOutcome &, PhaseTimes &);
+template std::uint32_t fight_timed<BlockRng<LehmerFastRng>>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                            const BattleOutcome &, PhaseTimes &);
+template std::uint32_t fight_timed<Xoshiro128PlusRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                      const BattleOutcome &, PhaseTimes &);
+template std::uint32_t fight_timed<Pcg32Rng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                             const BattleOutcome &, PhaseTimes &);
+
+template std::uint32_t fight_groups<LehmerRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                               const BattleOutcome &);
+template std::uint32_t fight_groups<LehmerFastRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                   const BattleOutcome &);
+template std::uint32_t fight_groups<BlockRng<LehmerFastRng>>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                             const BattleOutcome &);
+template std::uint32_t fight_groups<Xoshiro128PlusRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                       const BattleOutcome &);
+template std::uint32_t fight_groups<Pcg32Rng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                              const BattleOutcome &);
+
+template std::uint32_t fight_compact<LehmerRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                const BattleOutcome &);
+template std::uint32_t fight_compact<LehmerFastRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                    const BattleOutcome &);
+template std::uint32_t fight_compact<BlockRng<LehmerFastRng>>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                              const BattleOutcome &);
+template std::uint32_t fight_compact<Xoshiro128PlusRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                        const BattleOutcome &);
+template std::uint32_t fight_compact<Pcg32Rng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                               const BattleOutcome &);
+
+template std::uint32_t fight_parallel<LehmerRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                const BattleOutcome &, ThreadPool &);
+template std::uint32_t fight_parallel<LehmerFastRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                    const BattleOutcome &, ThreadPool &);
+template std::uint32_t fight_parallel<BlockRng<LehmerFastRng>>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                              const BattleOutcome &, ThreadPool &);
+template std::uint32_t fight_parallel<Xoshiro128PlusRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                        const BattleOutcome &, ThreadPool &);
+template std::uint32_t fight_parallel<Pcg32Rng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                               const BattleOutcome &, ThreadPool &);
+
+template std::uint32_t fight_batched<LehmerRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                const BattleOutcome &);
+template std::uint32_t fight_batched<LehmerFastRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                    const BattleOutcome &);
+template std::uint32_t fight_batched<BlockRng<LehmerFastRng>>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                              const BattleOutcome &);
+template std::uint32_t fight_batched<Xoshiro128PlusRng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                                        const BattleOutcome &);
+template std::uint32_t fight_batched<Pcg32Rng>(BattleWorkspace &, const BattleSpec &, std::uint32_t,
+                                               const BattleOutcome &);
+
 } // namespace dataset_gen
@@ -1,13 +1,20 @@
 #ifndef DATASET_GEN_BATTLE_ENGINE_HPP
 #define DATASET_GEN_BATTLE_ENGINE_HPP
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <span>
 #include <vector>
 
+#include "Random.hpp"
 #include "UnitGroups.hpp"
+#include "Util.hpp"
 
 namespace dataset_gen {
 
+class ThreadPool;
+
 struct CombatTechs {
   std::uint8_t weapons{};
   std::uint8_t shielding{};
@@ -19,20 +26,287 @@ struct Combatant {
   UnitGroups<std::uint32_t> unit_groups{};
 };
 
-struct Unit {
+// Units are stored as a structure of arrays. The arrays are padded to a multiple of unit_padding elements and hulls
+// past num_alive are kept at 0, so that the vectorized passes can always process whole vectors.
+constexpr std::uint32_t unit_padding = 16;
+
+struct Party {
+  std::span<const Combatant> combatants{};
+  AlignedVector<float> shields{};
+  AlignedVector<float> hulls{};
+  AlignedVector<std::uint8_t> kinds{};
+  AlignedVector<std::uint8_t> combatant_ids{};
+  // Shield of a unit with restored shields, indexed by combatant_id * UnitKindEnd + kind.
+  std::vector<float> max_shields{};
+  std::uint32_t num_alive{};
+
+  // Compiled per-battle constants. Every (combatant, kind) present at the start of the battle gets a dense slot;
+  // slots maps combatant_id * UnitKindEnd + kind to it.
+  std::vector<std::uint16_t> slots{};
+  std::vector<std::uint8_t> slot_kinds{};
+  std::vector<std::uint8_t> slot_combatant_ids{};
+  std::vector<float> slot_damages{};
+  std::vector<float> slot_max_shields{};
+  std::vector<float> slot_max_hulls{};
+  // A unit with hull below this may explode after being hit.
+  std::vector<float> slot_explosion_hulls{};
+};
+
+// Constants of one party firing at the other, indexed by [shooter slot * number of target slots + target slot].
+struct FireTable {
+  std::uint32_t num_target_slots{};
+  std::vector<float> shield_damages{};
+  // shield_damages in whole percents of the max shield of the target (100 without shields), for fight_compact().
+  std::vector<std::uint8_t> shield_percents{};
+  std::vector<std::uint32_t> rapid_fires{};
+};
+
+// Replicas of one battle fought side by side in lanes. The units of both parties are interleaved by lane: unit u of
+// lane l is at index u * num_lanes + l, the attackers being units [0, num_units[0]) and the defenders the next
+// num_units[1]. Slots of both parties share one numbering too, attacker slots first.
+struct LaneBattle {
+  std::uint32_t num_lanes{};
+  std::uint32_t num_units[2]{};
+  std::uint32_t num_slots{};
+
+  // Indexed by slot.
+  std::vector<std::uint8_t> slot_kinds{};
+  std::vector<std::uint8_t> slot_combatant_ids{};
+  std::vector<float> slot_damages{};
+  std::vector<float> slot_max_shields{};
+  std::vector<float> slot_max_hulls{};
+  std::vector<float> slot_explosion_hulls{};
+  // Indexed by shooter slot * num_slots + target slot.
+  std::vector<float> shield_damages{};
+  std::vector<std::uint32_t> rapid_fires{};
+  // 1.0 / rapid fire, for the vectorized modulo.
+  std::vector<double> rapid_fire_inverses{};
+
+  // Units at the start of the battle, indexed by unit.
+  std::vector<float> initial_shields{};
+  std::vector<float> initial_hulls{};
+  std::vector<std::uint32_t> initial_slots{};
+
+  // Units of the lanes. Slots are stored as 32 bits, for the vector gathers and scatters.
+  AlignedVector<float> shields{};
+  AlignedVector<float> hulls{};
+  AlignedVector<std::uint32_t> slots{};
+};
+
+// A unit of a GroupParty that is not as it was at the start of the battle. unit is its index among the alive units of
+// the party plus one, numbered as in Party; 0 marks an empty bucket.
+struct DamagedUnit {
+  std::uint32_t unit{};
+  std::uint32_t slot{};
   float shield{};
   float hull{};
-  std::uint8_t kind{};
-  std::uint8_t combatant_id{};
 };
 
-struct Party {
-  std::vector<Combatant> &combatants;
-  std::vector<Unit> units{};
+// A party stored as counted groups, one per slot: the units of a slot that were not hit are only counted, and a unit
+// is stored when it is first hit. The units keep the numbers they would have in Party, so that a random number picks
+// the same target in both.
+struct GroupParty {
+  // Alive units of each slot at the start of the round.
+  std::vector<std::uint32_t> num_alive{};
+  // Number of the first unit of each slot, followed by the number of alive units.
+  std::vector<std::uint32_t> slot_begins{};
+  // Open addressing hash table of the damaged units, at most half full or with a bucket per alive unit.
+  std::vector<DamagedUnit> buckets{};
+  std::uint32_t num_damaged{};
+  // The damaged units in order, between the rounds.
+  std::vector<DamagedUnit> damaged{};
+};
+
+// The state of a unit in 8 bytes, so that a hit reads and writes a single cache line, where Party spreads 10 bytes over
+// 4 arrays.
+struct CompactUnit {
+  // In thousandths of a point.
+  std::uint32_t hull;
+  std::uint16_t slot;
+  // In percents of the max shield of the slot.
+  std::uint8_t shield_percents;
+};
+
+struct CompactParty {
+  std::vector<CompactUnit> units{};
   std::uint32_t num_alive{};
+
+  // Indexed by slot: 1% of the max shield, and the max and explosion hulls in thousandths of a point.
+  std::vector<float> slot_shield_steps{};
+  std::vector<float> slot_max_hulls{};
+  std::vector<float> slot_explosion_hulls{};
+};
+
+// Shots of one party in a round of parallel fire, bucketed by chunk of shooters and range of targets:
+// buckets[chunk * num_ranges + range] holds the shots of the chunk at the range, each a target index << 16 | shooter
+// slot, in the order they were fired.
+struct ParallelFire {
+  std::uint32_t num_ranges{};
+  std::vector<std::vector<std::uint64_t>> buckets{};
+};
+
+// Shots of one party in a batch of fight_batched(), each a target index << 16 | shooter slot: shots in the order they
+// were fired and sorted by block of targets, with block_begins the positions of the blocks in sorted.
+struct HitBatches {
+  std::vector<std::uint64_t> shots{};
+  std::vector<std::uint64_t> sorted{};
+  std::vector<std::uint32_t> block_begins{};
+};
+
+enum class BattlePhase {
+  CreateParty,
+  Fire,
+  UpdateUnits,
+  CountUnits,
+};
+
+constexpr std::size_t num_battle_phases = 4;
+constexpr const char *battle_phase_names[num_battle_phases] = {"create_party", "fire", "update_units", "count_units"};
+
+constexpr std::uint32_t max_rounds = 6;
+
+// Counters of the battles fought by fight(), fight_groups() and fight_replicas(), kept only in builds with
+// DATASET_GEN_ENABLE_STATS (engine_stats_enabled). Replicas are then fought without lanes, so that every shot counts.
+struct EngineStats {
+  std::uint64_t battles{};
+  // Shooters and shots per shooter kind; the shots past the first of each shooter are rapid fire.
+  UnitGroups<std::uint64_t> shooters{};
+  UnitGroups<std::uint64_t> shots{};
+  // Shots at units destroyed earlier in the round, and shots absorbed by the shields.
+  std::uint64_t dead_target_hits{};
+  std::uint64_t shield_bounces{};
+  std::uint64_t explosion_rolls{};
+  std::uint64_t explosion_kills{};
+  // Battles by the number of rounds fought.
+  std::array<std::uint64_t, max_rounds + 1> rounds{};
+  // Time stamp counter ticks spent in each phase.
+  std::array<std::uint64_t, num_battle_phases> phase_ticks{};
+
+  void merge(const EngineStats &other);
+};
+
+#if defined(DATASET_GEN_STATS)
+constexpr bool engine_stats_enabled = true;
+#else
+constexpr bool engine_stats_enabled = false;
+#endif
+
+// Buffers reused by all the battles fought in it, so that after the first few battles no memory is allocated.
+// A workspace must not be shared by threads; each thread should keep its own.
+struct BattleWorkspace {
+  Party attackers{};
+  Party defenders{};
+  FireTable attackers_table{};
+  FireTable defenders_table{};
+  LaneBattle lanes{};
+  GroupParty attacker_groups{};
+  GroupParty defender_groups{};
+  CompactParty compact_attackers{};
+  CompactParty compact_defenders{};
+  ParallelFire parallel_fire{};
+  HitBatches hit_batches{};
+  EngineStats stats{};
+};
+
+struct BattleSpec {
+  std::span<const Combatant> attackers{};
+  std::span<const Combatant> defenders{};
+};
+
+// Caller-provided buffers receiving the units left after a battle, one UnitGroups per combatant of the spec.
+struct BattleOutcome {
+  std::span<UnitGroups<std::uint32_t>> attackers{};
+  std::span<UnitGroups<std::uint32_t>> defenders{};
+  std::uint32_t rounds{};
+};
+
+// Fights one battle with random numbers drawn from an Rng seeded with seed and returns the number of rounds.
+// Instantiated for the engines selectable with RngKind.
+template <typename Rng>
+std::uint32_t fight(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                    const BattleOutcome &outcome);
+
+// Time spent in each phase of the battles fought with fight_timed(), and their shots and rounds. Creating the parties
+// includes compiling the fire tables; updating the units includes restoring the shields.
+struct PhaseTimes {
+  std::array<std::uint64_t, num_battle_phases> ns{};
+  std::uint64_t shots{};
+  std::uint64_t rounds{};
+};
+
+// fight() adding the time of each phase and the shots and rounds to times.
+template <typename Rng>
+std::uint32_t fight_timed(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                          const BattleOutcome &outcome, PhaseTimes &times);
+
+// The same battle as fight(), but with the parties stored as counted groups, so that the memory and the passes over the
+// units grow with the number of units hit rather than with the size of the fleets.
+template <typename Rng>
+std::uint32_t fight_groups(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                           const BattleOutcome &outcome);
+
+// The same battle as fight(), with the units in CompactParty, for fleets too large for the caches. It draws the same
+// random numbers, but the hulls are rounded to thousandths of a point, so a rare hit ends differently; the outcomes
+// follow the same distribution as fight()'s.
+template <typename Rng>
+std::uint32_t fight_compact(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                            const BattleOutcome &outcome);
+
+// fight() with the shots of every round fired over the threads of pool, for battles too large for one thread. The
+// shooters are split in chunks drawing their own random numbers, and the targets in ranges applying the hits in the
+// order of fight(), so the outcomes follow the same distribution as fight()'s, though not the same outcome for a seed.
+// They do not depend on the number of threads. Must not be called from a job of pool. No EngineStats are kept.
+template <typename Rng>
+std::uint32_t fight_parallel(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                             const BattleOutcome &outcome, ThreadPool &pool);
+
+// fight() on one thread with the hits sorted as in fight_parallel(): the shots of a round are drawn first, then applied
+// block of targets after block of targets, so that the targets hit stay in the caches instead of every shot missing
+// them in a large party. A target receives its hits in the order of fight(), but the explosions draw later random
+// numbers, so the outcomes follow the same distribution as fight()'s, though not the same outcome for a seed.
+template <typename Rng>
+std::uint32_t fight_batched(BattleWorkspace &workspace, const BattleSpec &spec, std::uint32_t seed,
+                            const BattleOutcome &outcome);
+
+// Whether every engine ends the battle of spec with the units it started with, whatever the seed: a side has no units,
+// or no shot of either side can change a unit of the other, as it has no damage or bounces off a shield 100 times
+// stronger without weakening it.
+bool is_trivial_battle(const BattleSpec &spec);
+
+// Fights specs[i] with seeds[i] into outcomes[i], for each i, with the engine rng.
+void fight_many(BattleWorkspace &workspace, std::span<const BattleSpec> specs, std::span<const std::uint32_t> seeds,
+                std::span<BattleOutcome> outcomes, RngKind rng = RngKind::Lehmer);
+
+enum class EngineKind {
+  Units,
+  Groups,
+  Compact,
+  Batched,
+};
+
+constexpr const char *engine_kind_names[] = {"units", "groups", "compact", "batched"};
+
+// Numbers of lanes fight_replicas() supports besides 0 and 1.
+constexpr std::uint32_t replica_lanes[] = {8, 16};
+
+struct FightOptions {
+  RngKind rng = RngKind::Lehmer;
+  // Units fights with fight() or in lanes, Groups with fight_groups(), Compact with fight_compact(), Batched with
+  // fight_batched().
+  EngineKind engine = EngineKind::Units;
+  // Lanes of the units engine. With 0 the number of lanes is picked for the RNG engine and the instruction set.
+  std::uint32_t lanes = 0;
+  // If set, the replicas are fought one after another with fight_parallel() on this pool, whatever the engine and the
+  // lanes. Meant for very large battles.
+  ThreadPool *pool = nullptr;
 };
 
-std::uint32_t fight(std::vector<Combatant> &attackers, std::vector<Combatant> &defenders, std::uint32_t seed);
+// Fights replicas of one battle, replica i with seeds[i] into outcomes[i]. With lanes > 1, lanes replicas are fought
+// at once in lockstep, one shot of each per step, and a lane starts the next replica as soon as its battle ends. Large
+// battles are always fought without lanes. The outcomes are the same for every number of lanes and for the units and
+// groups engines, but not for the compact and batched engines or with a pool.
+void fight_replicas(BattleWorkspace &workspace, const BattleSpec &spec, std::span<const std::uint32_t> seeds,
+                    std::span<BattleOutcome> outcomes, const FightOptions &options = {});
 
 } // namespace dataset_gen
 
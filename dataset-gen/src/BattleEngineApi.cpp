@@ -0,0 +1,119 @@
+#include "BattleEngineApi.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "BattleEngine.hpp"
+#include "Random.hpp"
+#include "RunningStats.hpp"
+#include "ThreadPool.hpp"
+#include "UnitGroups.hpp"
+#include "Units.hpp"
+
+using namespace dataset_gen;
+
+namespace {
+
+constexpr std::size_t num_techs = 3;
+
+// Buffers of one thread of the pool.
+struct ThreadState {
+  BattleWorkspace workspace{};
+  std::vector<std::uint32_t> seeds{};
+  std::vector<UnitGroups<std::uint32_t>> attacker_outcomes{};
+  std::vector<UnitGroups<std::uint32_t>> defender_outcomes{};
+  std::vector<BattleOutcome> outcomes{};
+
+  void resize(std::uint32_t num_replicas) {
+    if (seeds.size() >= num_replicas)
+      return;
+    seeds.resize(num_replicas);
+    attacker_outcomes.resize(num_replicas);
+    defender_outcomes.resize(num_replicas);
+    outcomes.resize(num_replicas);
+    for (std::uint32_t i = 0; i < num_replicas; ++i)
+      outcomes[i] = BattleOutcome{.attackers = {&attacker_outcomes[i], 1}, .defenders = {&defender_outcomes[i], 1}};
+  }
+};
+
+Combatant read_combatant(const std::uint8_t *techs, const std::uint32_t *units) {
+  Combatant c{};
+  c.techs = {techs[0], techs[1], techs[2]};
+  for (std::uint32_t kind = 0; kind < num_ship_kinds; ++kind)
+    c.unit_groups[kind] = units[kind];
+  return c;
+}
+
+void write_stats(const RunningStats &stats, double *means, double *sds) {
+  const UnitGroups<double> sd = stats.count > 1 ? stats.sd() : UnitGroups<double>{};
+  for (std::uint32_t kind = 0; kind < num_ship_kinds; ++kind) {
+    means[kind] = stats.mean[kind];
+    sds[kind] = sd[kind];
+  }
+}
+
+} // namespace
+
+struct BattleEngine {
+  ThreadPool pool;
+  std::vector<ThreadState> threads;
+
+  explicit BattleEngine(std::uint32_t num_threads) : pool{num_threads}, threads(pool.num_threads()) {}
+};
+
+extern "C" {
+
+std::uint32_t battle_engine_api_version(void) { return BATTLE_ENGINE_API_VERSION; }
+
+// Defenses have no attributes yet, and would take no part in the battles: they are not exposed.
+std::uint32_t battle_engine_num_unit_kinds(void) { return num_ship_kinds; }
+
+const char *battle_engine_unit_name(std::uint32_t kind) { return kind < num_ship_kinds ? unit_names[kind] : nullptr; }
+
+BattleEngine *battle_engine_create(std::uint32_t num_threads) { return new BattleEngine{num_threads}; }
+
+void battle_engine_destroy(BattleEngine *engine) { delete engine; }
+
+int battle_engine_fight(BattleEngine *engine, std::size_t num_battles, const std::uint8_t *techs,
+                        const std::uint32_t *units, std::uint32_t num_replicas, std::uint32_t seed, double *means,
+                        double *sds) {
+  if (engine == nullptr || num_replicas == 0)
+    return BATTLE_ENGINE_INVALID_ARGUMENT;
+  if (num_battles == 0)
+    return BATTLE_ENGINE_OK;
+  if (techs == nullptr || units == nullptr || means == nullptr || sds == nullptr)
+    return BATTLE_ENGINE_INVALID_ARGUMENT;
+
+  engine->pool.run(num_battles, [&](std::uint32_t thread, std::size_t battle) {
+    ThreadState &state = engine->threads[thread];
+    state.resize(num_replicas);
+
+    const std::size_t offset = battle * 2 * num_ship_kinds;
+    const Combatant attacker = read_combatant(&techs[battle * 2 * num_techs], &units[offset]);
+    const Combatant defender =
+        read_combatant(&techs[battle * 2 * num_techs + num_techs], &units[offset + num_ship_kinds]);
+    const BattleSpec spec{.attackers = {&attacker, 1}, .defenders = {&defender, 1}};
+
+    // Seeded like the rows of dataset-gen: from the seed and the index of the battle.
+    RowRng rng{seed, battle};
+    for (std::uint32_t i = 0; i < num_replicas; ++i)
+      state.seeds[i] = rng();
+    fight_replicas(state.workspace, spec, std::span{state.seeds}.first(num_replicas),
+                   std::span{state.outcomes}.first(num_replicas));
+
+    RunningStats attacker_stats{};
+    RunningStats defender_stats{};
+    for (std::uint32_t i = 0; i < num_replicas; ++i) {
+      attacker_stats.add(state.attacker_outcomes[i]);
+      defender_stats.add(state.defender_outcomes[i]);
+    }
+    write_stats(attacker_stats, &means[offset], &sds[offset]);
+    write_stats(defender_stats, &means[offset + num_ship_kinds], &sds[offset + num_ship_kinds]);
+  });
+
+  return BATTLE_ENGINE_OK;
+}
+
+} // extern "C"
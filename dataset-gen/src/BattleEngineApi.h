@@ -0,0 +1,57 @@
+#ifndef DATASET_GEN_BATTLE_ENGINE_API_H
+#define DATASET_GEN_BATTLE_ENGINE_API_H
+
+// C API of the battle engine library (libbattle-engine), for use from C and through FFIs such as Python's ctypes.
+//
+// Battles are passed as contiguous arrays, battle after battle, the attacker before the defender:
+//   techs:  uint8_t[num_battles][2][3], weapons, shielding and armor
+//   units:  uint32_t[num_battles][2][battle_engine_num_unit_kinds()], the ships (defenses have no attributes yet)
+// and the results are written into caller buffers of the same shape as units:
+//   means, sds: double[num_battles][2][battle_engine_num_unit_kinds()]
+// with the mean and the sample standard deviation of the units left over num_replicas replicas of each battle.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define BATTLE_ENGINE_EXPORT __declspec(dllexport)
+#else
+#define BATTLE_ENGINE_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BATTLE_ENGINE_API_VERSION 2
+
+#define BATTLE_ENGINE_OK 0
+#define BATTLE_ENGINE_INVALID_ARGUMENT (-1)
+
+typedef struct BattleEngine BattleEngine;
+
+BATTLE_ENGINE_EXPORT uint32_t battle_engine_api_version(void);
+
+BATTLE_ENGINE_EXPORT uint32_t battle_engine_num_unit_kinds(void);
+
+// Name of the unit kind, or NULL if there is no such kind.
+BATTLE_ENGINE_EXPORT const char *battle_engine_unit_name(uint32_t kind);
+
+// Creates an engine fighting with num_threads threads, 0 for one per available CPU. The threads are kept until the
+// engine is destroyed.
+BATTLE_ENGINE_EXPORT BattleEngine *battle_engine_create(uint32_t num_threads);
+
+BATTLE_ENGINE_EXPORT void battle_engine_destroy(BattleEngine *engine);
+
+// Fights num_replicas replicas of each battle and writes the means and the standard deviations (0 with a single
+// replica). Replica seeds are derived from seed and the index of the battle, as the rows of dataset-gen, so the
+// results do not depend on the number of threads. Calls from several threads on the same engine are serialized.
+BATTLE_ENGINE_EXPORT int battle_engine_fight(BattleEngine *engine, size_t num_battles, const uint8_t *techs,
+                                             const uint32_t *units, uint32_t num_replicas, uint32_t seed,
+                                             double *means, double *sds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // !DATASET_GEN_BATTLE_ENGINE_API_H
@@ -0,0 +1,738 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Args.hpp"
+#include "BattleEngine.hpp"
+#include "BattleServerProtocol.hpp"
+#include "RunningStats.hpp"
+#include "ThreadPool.hpp"
+#include "UnitGroups.hpp"
+#include "Units.hpp"
+
+using namespace dataset_gen;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Units per side of a fight request, to bound the memory of a battle.
+constexpr std::uint64_t max_units_per_side = 10'000'000;
+
+// Options
+
+const char *opt_socket = "battle-server.sock";
+std::uint32_t opt_num_threads = 0;
+std::uint32_t opt_chunk_size = 16;
+std::uint32_t opt_max_replicas = 100'000;
+std::uint64_t opt_parallel_fire_units = 1'000'000;
+std::uint32_t opt_max_pending = 64;
+std::uint64_t opt_max_queued_replicas = 4'000'000;
+std::uint64_t opt_max_batch_units = 100'000'000;
+
+void parse_args(const char *const *argv) {
+  const char *arg0 = *argv++;
+  for (; *argv != nullptr; ++argv) {
+    if (std::strcmp(*argv, "-h") == 0 || std::strcmp(*argv, "--help") == 0) {
+      std::cout << "Usage: " << arg0 << " [OPTIONS]\n"
+                << '\n'
+                << "Fights battles requested over a Unix domain socket (protocol in BattleServerProtocol.hpp).\n"
+                << "Requests arriving together are fought as one batch, split in chunks of replicas over the threads.\n"
+                << "Stats requests are answered while a batch is fought.\n"
+                << "Battles with many units are fought one at a time instead, each round fired over all the threads.\n"
+                << '\n'
+                << "Options:\n"
+                << "  --chunk-size n     Number of replicas per work item (default: 16)\n"
+                << "  --max-batch-units n\n"
+                << "                     Max replicas x units of the requests fought in one batch; a larger request\n"
+                << "                     is fought alone (default: 100000000)\n"
+                << "  --max-pending n    Max requests of a connection waiting for their responses, beyond which the\n"
+                << "                     connection is not read (default: 64)\n"
+                << "  --max-queued-replicas n\n"
+                << "                     Max replicas x combatants of all the requests waiting for their responses,\n"
+                << "                     beyond which no connection is read (default: 4000000, about 350 MB)\n"
+                << "  --max-replicas n   Max number of replicas of a request (default: 100000)\n"
+                << "  --num-threads n    Number of threads (default: 0, one per available CPU)\n"
+                << "  --parallel-fire-units n\n"
+                << "                     Min number of units of a battle fired over all the threads\n"
+                << "                     (default: 1000000, 0 never)\n"
+                << "  --socket path      Socket path (default: battle-server.sock)\n";
+      std::exit(0);
+    } else if (std::strcmp(*argv, "--chunk-size") == 0) {
+      opt_chunk_size = parse_int_arg_or_die<std::uint32_t>(*++argv, "--chunk-size");
+      if (opt_chunk_size == 0) {
+        std::cerr << "--chunk-size must be at least 1\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--max-batch-units") == 0) {
+      opt_max_batch_units = parse_int_arg_or_die<std::uint64_t>(*++argv, "--max-batch-units");
+    } else if (std::strcmp(*argv, "--max-pending") == 0) {
+      opt_max_pending = parse_int_arg_or_die<std::uint32_t>(*++argv, "--max-pending");
+      if (opt_max_pending == 0) {
+        std::cerr << "--max-pending must be at least 1\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--max-queued-replicas") == 0) {
+      opt_max_queued_replicas = parse_int_arg_or_die<std::uint64_t>(*++argv, "--max-queued-replicas");
+      if (opt_max_queued_replicas == 0) {
+        std::cerr << "--max-queued-replicas must be at least 1\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--max-replicas") == 0) {
+      opt_max_replicas = parse_int_arg_or_die<std::uint32_t>(*++argv, "--max-replicas");
+    } else if (std::strcmp(*argv, "--num-threads") == 0) {
+      opt_num_threads = parse_int_arg_or_die<std::uint32_t>(*++argv, "--num-threads");
+    } else if (std::strcmp(*argv, "--parallel-fire-units") == 0) {
+      opt_parallel_fire_units = parse_int_arg_or_die<std::uint64_t>(*++argv, "--parallel-fire-units");
+    } else if (std::strcmp(*argv, "--socket") == 0) {
+      opt_socket = *++argv;
+      if (opt_socket == nullptr) {
+        std::cerr << "Failed to parse argument --socket\n";
+        std::exit(1);
+      }
+    } else {
+      std::cerr << "Unknown argument " << *argv << '\n';
+      std::exit(1);
+    }
+  }
+}
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int /*signal*/) { stop_requested = 1; }
+
+// Stats
+
+// Latencies by powers of two of microseconds: bucket i counts the latencies in [2^(i-1), 2^i) us, bucket 0 those under
+// 1 us and the last bucket all the longer ones.
+struct LatencyHistogram {
+  static constexpr std::uint32_t num_buckets = 26;
+  std::array<std::uint64_t, num_buckets> counts{};
+
+  void add(Clock::duration latency) {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    ++counts[std::min<std::size_t>(std::bit_width(static_cast<std::uint64_t>(std::max(us, decltype(us){0}))),
+                                   num_buckets - 1)];
+  }
+};
+
+struct ServerStats {
+  Clock::time_point start = Clock::now();
+  std::uint64_t num_requests = 0;
+  std::uint64_t num_bad_requests = 0;
+  std::uint64_t num_battles = 0;
+  std::uint64_t num_batches = 0;
+  // From the server reading a fight request to the start of its batch, and to its response being ready. Time spent in
+  // the socket buffer while the server is not reading the connection is not seen by the server; clients measure it.
+  LatencyHistogram queue_latency{};
+  LatencyHistogram latency{};
+};
+
+// Connections
+
+// Unsent responses of a connection beyond which its requests are no longer read.
+constexpr std::size_t max_unsent_bytes = 4 << 20;
+
+struct Connection {
+  // Identifies the connection in the jobs, which may outlive it.
+  std::uint64_t id = 0;
+  int fd = -1;
+  std::vector<char> in{};
+  std::vector<char> out{};
+  std::size_t out_begin = 0;
+  // Fight requests read and not answered yet.
+  std::uint32_t num_pending = 0;
+  // The client is done sending; the connection is closed once the responses are sent.
+  bool eof = false;
+  // Closed at the end of the iteration, without sending the pending responses.
+  bool closed = false;
+
+  bool has_frame() const {
+    if (in.size() < sizeof(ServerFrameHeader))
+      return false;
+    ServerFrameHeader header;
+    std::memcpy(&header, in.data(), sizeof(header));
+    return in.size() - sizeof(header) >= header.payload_size;
+  }
+};
+
+void append_frame(Connection &connection, std::uint8_t type, ServerStatus status, std::uint32_t request_id,
+                  std::span<const char> payload) {
+  const ServerFrameHeader header{
+      .magic = server_magic,
+      .version = server_version,
+      .type = type,
+      .status = static_cast<std::uint8_t>(status),
+      .request_id = request_id,
+      .payload_size = static_cast<std::uint32_t>(payload.size()),
+  };
+  const char *header_bytes = reinterpret_cast<const char *>(&header);
+  connection.out.insert(connection.out.end(), header_bytes, header_bytes + sizeof(header));
+  connection.out.insert(connection.out.end(), payload.begin(), payload.end());
+}
+
+// Fight requests
+
+struct FightJob {
+  std::uint64_t connection_id;
+  std::uint32_t request_id;
+  Clock::time_point received;
+  std::uint32_t num_attackers;
+  std::uint64_t num_units;
+  // Attackers, then defenders.
+  std::vector<Combatant> combatants;
+  std::vector<std::uint32_t> seeds;
+  std::vector<UnitGroups<std::uint32_t>> outcome_units;
+  std::vector<BattleOutcome> outcomes;
+
+  BattleSpec spec() const {
+    return {.attackers = std::span{combatants}.first(num_attackers),
+            .defenders = std::span{combatants}.subspan(num_attackers)};
+  }
+
+  // Outcomes held until the response is sent, replicas x combatants: what the job costs in memory.
+  std::uint64_t num_outcomes() const { return outcome_units.size(); }
+  // Replicas x units: what the job costs to fight.
+  std::uint64_t work() const { return seeds.size() * num_units; }
+};
+
+bool parse_fight(std::span<const char> payload, FightJob &job) {
+  FightRequestHeader header;
+  if (payload.size() < sizeof(header))
+    return false;
+  std::memcpy(&header, payload.data(), sizeof(header));
+  if (header.num_replicas == 0 || header.num_replicas > opt_max_replicas || header.num_attackers == 0 ||
+      header.num_defenders == 0 || header.num_attackers > server_max_combatants ||
+      header.num_defenders > server_max_combatants)
+    return false;
+
+  const std::uint32_t num_combatants = header.num_attackers + header.num_defenders;
+  job.num_attackers = header.num_attackers;
+  job.combatants.assign(num_combatants, Combatant{});
+  std::uint64_t side_units[2] = {};
+  std::size_t pos = sizeof(header);
+  for (std::uint32_t i = 0; i < num_combatants; ++i) {
+    if (payload.size() - pos < 4)
+      return false;
+    Combatant &combatant = job.combatants[i];
+    combatant.techs = {static_cast<std::uint8_t>(payload[pos]), static_cast<std::uint8_t>(payload[pos + 1]),
+                       static_cast<std::uint8_t>(payload[pos + 2])};
+    const auto num_groups = static_cast<std::uint8_t>(payload[pos + 3]);
+    pos += 4;
+
+    std::uint64_t &units = side_units[i < header.num_attackers ? 0 : 1];
+    for (std::uint32_t group = 0; group < num_groups; ++group) {
+      if (payload.size() - pos < 5)
+        return false;
+      const auto kind = static_cast<std::uint8_t>(payload[pos]);
+      std::uint32_t count;
+      std::memcpy(&count, payload.data() + pos + 1, sizeof(count));
+      pos += 5;
+      units += count;
+      // Defenses have no attributes yet, and would take no part in the battle.
+      if (kind >= num_ship_kinds || units > max_units_per_side)
+        return false;
+      combatant.unit_groups[kind] += count;
+    }
+  }
+  if (pos != payload.size())
+    return false;
+  job.num_units = side_units[0] + side_units[1];
+
+  // Seeded from the request only, so that its results do not depend on the batch it is fought in.
+  std::seed_seq request_seed{header.seed};
+  std::mt19937 rng{request_seed};
+  job.seeds.resize(header.num_replicas);
+  for (std::uint32_t &seed : job.seeds)
+    seed = static_cast<std::uint32_t>(rng());
+
+  job.outcome_units.resize(std::size_t{header.num_replicas} * num_combatants);
+  job.outcomes.resize(header.num_replicas);
+  for (std::uint32_t i = 0; i < header.num_replicas; ++i) {
+    const auto units = std::span{job.outcome_units}.subspan(std::size_t{i} * num_combatants, num_combatants);
+    job.outcomes[i] = {.attackers = units.first(header.num_attackers),
+                       .defenders = units.subspan(header.num_attackers)};
+  }
+  return true;
+}
+
+std::vector<char> fight_response_payload(const FightJob &job) {
+  const auto num_combatants = static_cast<std::uint32_t>(job.combatants.size());
+  const FightResponseHeader header{
+      .num_replicas = static_cast<std::uint32_t>(job.seeds.size()),
+      .num_combatants = static_cast<std::uint16_t>(num_combatants),
+      .num_unit_kinds = num_ship_kinds,
+  };
+  std::vector<double> values(2 * num_combatants * num_ship_kinds);
+  for (std::uint32_t c = 0; c < num_combatants; ++c) {
+    RunningStats stats{};
+    for (std::size_t i = 0; i < job.seeds.size(); ++i)
+      stats.add(job.outcome_units[i * num_combatants + c]);
+    const UnitGroups<double> sd = stats.count > 1 ? stats.sd() : UnitGroups<double>{};
+    for (std::uint32_t kind = 0; kind < num_ship_kinds; ++kind) {
+      values[c * num_ship_kinds + kind] = stats.mean[kind];
+      values[(num_combatants + c) * num_ship_kinds + kind] = sd[kind];
+    }
+  }
+
+  std::vector<char> payload(sizeof(header) + values.size() * sizeof(double));
+  std::memcpy(payload.data(), &header, sizeof(header));
+  std::memcpy(payload.data() + sizeof(header), values.data(), values.size() * sizeof(double));
+  return payload;
+}
+
+// Server
+//
+// The main thread polls the socket and the connections, reads the requests and answers the stats requests at once.
+// Fight requests are queued and fought in batches, one at a time, by a batch thread on the thread pool (the batch
+// thread taking part); it wakes the main thread up through an eventfd when a batch is done, and the main thread sends
+// the responses. Requests arriving meanwhile are queued for the next batch.
+//
+// A connection is not read while it has --max-pending requests waiting for their responses or too many unsent
+// responses, and no connection is read while the queued requests hold --max-queued-replicas outcomes: the requests
+// wait in the socket buffers, and clients block once they are full. A batch takes the queued requests in order up to
+// --max-batch-units replicas x units, so that a burst is fought in several batches.
+
+class BattleServer {
+public:
+  BattleServer(int listen_fd, int done_fd)
+      : listen_fd_{listen_fd}, done_fd_{done_fd}, pool_{opt_num_threads}, workspaces_(pool_.num_threads()),
+        batch_thread_{[this] { fight_batches(); }} {}
+
+  ~BattleServer() {
+    {
+      std::lock_guard lock{mutex_};
+      stop_ = true;
+    }
+    batch_start_.notify_one();
+    batch_thread_.join();
+  }
+
+  void run() {
+    std::vector<pollfd> fds;
+    while (stop_requested == 0) {
+      fds.clear();
+      fds.push_back({.fd = listen_fd_, .events = POLLIN, .revents = 0});
+      fds.push_back({.fd = done_fd_, .events = POLLIN, .revents = 0});
+      for (const Connection &connection : connections_) {
+        const short events = static_cast<short>((wants_read(connection) ? POLLIN : 0) |
+                                                (connection.out_begin < connection.out.size() ? POLLOUT : 0));
+        fds.push_back({.fd = connection.fd, .events = events, .revents = 0});
+      }
+      if (::poll(fds.data(), fds.size(), -1) < 0) {
+        if (errno == EINTR)
+          continue;
+        std::cerr << "poll failed: " << std::strerror(errno) << '\n';
+        return;
+      }
+
+      if ((fds[1].revents & POLLIN) != 0)
+        finish_batch();
+
+      const Clock::time_point now = Clock::now();
+      for (std::size_t i = 0; i < connections_.size(); ++i) {
+        Connection &connection = connections_[i];
+        const short revents = fds[i + 2].revents;
+        if ((revents & (POLLIN | POLLHUP | POLLERR)) != 0 && wants_read(connection))
+          read_bytes(connection);
+        else if ((revents & (POLLHUP | POLLERR)) != 0)
+          connection.closed = true;
+      }
+      if ((fds[0].revents & POLLIN) != 0)
+        accept_connections();
+
+      // Also takes the requests left in the buffers when the limits stopped them before.
+      for (Connection &connection : connections_)
+        read_requests(connection, now);
+      if (!batch_running_ && !queue_.empty())
+        start_batch();
+
+      for (Connection &connection : connections_) {
+        if (!connection.closed)
+          write_responses(connection);
+        if (connection.eof && connection.num_pending == 0 && !connection.has_frame() &&
+            connection.out_begin == connection.out.size())
+          connection.closed = true;
+        if (connection.closed)
+          ::close(connection.fd);
+      }
+      std::erase_if(connections_, [](const Connection &connection) { return connection.closed; });
+      // The responses of the requests of closed connections could not be sent.
+      std::erase_if(queue_, [&](const FightJob &job) {
+        if (find_connection(job.connection_id) != nullptr)
+          return false;
+        queued_outcomes_ -= job.num_outcomes();
+        return true;
+      });
+    }
+
+    for (const Connection &connection : connections_)
+      ::close(connection.fd);
+  }
+
+private:
+  void accept_connections() {
+    for (;;) {
+      const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0)
+        break;
+      connections_.push_back(Connection{.id = next_connection_id_++, .fd = fd});
+    }
+  }
+
+  Connection *find_connection(std::uint64_t id) {
+    auto it = std::ranges::find(connections_, id, &Connection::id);
+    return it != connections_.end() ? &*it : nullptr;
+  }
+
+  // Whether another request of the connection may be taken.
+  bool accepts_request(const Connection &connection) const {
+    return !connection.closed && connection.num_pending < opt_max_pending &&
+           queued_outcomes_ < opt_max_queued_replicas &&
+           connection.out.size() - connection.out_begin < max_unsent_bytes;
+  }
+
+  // Whether to read more bytes of the connection: one frame at most is buffered beyond the requests it may take.
+  bool wants_read(const Connection &connection) const {
+    return !connection.eof && accepts_request(connection) &&
+           connection.in.size() < sizeof(ServerFrameHeader) + server_max_payload_size;
+  }
+
+  static void read_bytes(Connection &connection) {
+    char buffer[1 << 16];
+    while (connection.in.size() < sizeof(ServerFrameHeader) + server_max_payload_size) {
+      const ssize_t n = ::read(connection.fd, buffer, sizeof(buffer));
+      if (n > 0) {
+        connection.in.insert(connection.in.end(), buffer, buffer + n);
+        continue;
+      }
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n == 0)
+        connection.eof = true;
+      else if (errno != EAGAIN && errno != EWOULDBLOCK)
+        connection.closed = true;
+      break;
+    }
+  }
+
+  void read_requests(Connection &connection, Clock::time_point received) {
+    std::size_t pos = 0;
+    while (accepts_request(connection) && connection.in.size() - pos >= sizeof(ServerFrameHeader)) {
+      ServerFrameHeader header;
+      std::memcpy(&header, connection.in.data() + pos, sizeof(header));
+      if (header.magic != server_magic || header.payload_size > server_max_payload_size) {
+        connection.closed = true;
+        break;
+      }
+      if (connection.in.size() - pos - sizeof(header) < header.payload_size)
+        break;
+      handle_request(connection, header, std::span{connection.in}.subspan(pos + sizeof(header), header.payload_size),
+                     received);
+      pos += sizeof(header) + header.payload_size;
+    }
+    connection.in.erase(connection.in.begin(), connection.in.begin() + static_cast<std::ptrdiff_t>(pos));
+  }
+
+  void handle_request(Connection &connection, const ServerFrameHeader &header, std::span<const char> payload,
+                      Clock::time_point received) {
+    ++stats_.num_requests;
+    if (header.version != server_version || (header.type != static_cast<std::uint8_t>(ServerRequestType::Fight) &&
+                                             header.type != static_cast<std::uint8_t>(ServerRequestType::Stats))) {
+      ++stats_.num_bad_requests;
+      append_frame(connection, header.type, ServerStatus::Unsupported, header.request_id, {});
+      return;
+    }
+
+    if (header.type == static_cast<std::uint8_t>(ServerRequestType::Stats)) {
+      const std::string json = stats_json();
+      append_frame(connection, header.type, ServerStatus::Ok, header.request_id, json);
+      return;
+    }
+
+    FightJob &job = queue_.emplace_back();
+    job.connection_id = connection.id;
+    job.request_id = header.request_id;
+    job.received = received;
+    if (!parse_fight(payload, job)) {
+      queue_.pop_back();
+      ++stats_.num_bad_requests;
+      append_frame(connection, header.type, ServerStatus::BadRequest, header.request_id, {});
+      return;
+    }
+    ++connection.num_pending;
+    queued_outcomes_ += job.num_outcomes();
+  }
+
+  // Moves the first queued jobs into the batch and hands it to the batch thread.
+  void start_batch() {
+    const Clock::time_point start = Clock::now();
+    std::uint64_t work = 0;
+    while (!queue_.empty() && (batch_.empty() || work + queue_.front().work() <= opt_max_batch_units)) {
+      work += queue_.front().work();
+      stats_.queue_latency.add(start - queue_.front().received);
+      batch_.push_back(std::move(queue_.front()));
+      queue_.pop_front();
+    }
+
+    batch_running_ = true;
+    {
+      std::lock_guard lock{mutex_};
+      batch_ready_ = true;
+    }
+    batch_start_.notify_one();
+  }
+
+  // Sends the responses of the batch the batch thread is done with.
+  void finish_batch() {
+    std::uint64_t count;
+    if (::read(done_fd_, &count, sizeof(count)) != sizeof(count))
+      return;
+    {
+      std::lock_guard lock{mutex_};
+      if (!batch_done_)
+        return;
+      batch_done_ = false;
+    }
+
+    for (const FightJob &job : batch_) {
+      queued_outcomes_ -= job.num_outcomes();
+      Connection *connection = find_connection(job.connection_id);
+      if (connection != nullptr) {
+        --connection->num_pending;
+        if (!connection->closed) {
+          append_frame(*connection, static_cast<std::uint8_t>(ServerRequestType::Fight), ServerStatus::Ok,
+                       job.request_id, fight_response_payload(job));
+        }
+      }
+      stats_.latency.add(Clock::now() - job.received);
+      stats_.num_battles += job.seeds.size();
+    }
+    ++stats_.num_batches;
+    batch_.clear();
+    batch_running_ = false;
+  }
+
+  // Batch thread.
+  void fight_batches() {
+    for (;;) {
+      {
+        std::unique_lock lock{mutex_};
+        batch_start_.wait(lock, [&] { return stop_ || batch_ready_; });
+        if (!batch_ready_)
+          return;
+        batch_ready_ = false;
+      }
+
+      fight_batch();
+
+      {
+        std::lock_guard lock{mutex_};
+        batch_done_ = true;
+      }
+      const std::uint64_t one = 1;
+      if (::write(done_fd_, &one, sizeof(one)) != sizeof(one)) {
+        std::cerr << "Failed to signal the end of a batch: " << std::strerror(errno) << '\n';
+        std::abort();
+      }
+    }
+  }
+
+  void fight_batch() {
+    items_.clear();
+    for (std::uint32_t job = 0; job < batch_.size(); ++job) {
+      if (is_parallel_fire(batch_[job]))
+        continue;
+      for (std::uint32_t first = 0; first < batch_[job].seeds.size(); first += opt_chunk_size)
+        items_.emplace_back(job, first);
+    }
+
+    pool_.run(items_.size(), [&](std::uint32_t thread, std::size_t item) {
+      const auto [job_index, first] = items_[item];
+      FightJob &job = batch_[job_index];
+      const std::size_t n = std::min<std::size_t>(opt_chunk_size, job.seeds.size() - first);
+      fight_replicas(workspaces_[thread], job.spec(), std::span{job.seeds}.subspan(first, n),
+                     std::span{job.outcomes}.subspan(first, n));
+    });
+
+    // A battle this large keeps all the threads busy on its own; the pool is free again here.
+    for (FightJob &job : batch_) {
+      if (is_parallel_fire(job))
+        fight_replicas(workspaces_[0], job.spec(), job.seeds, job.outcomes, {.pool = &pool_});
+    }
+  }
+
+  static bool is_parallel_fire(const FightJob &job) {
+    return opt_parallel_fire_units != 0 && job.num_units >= opt_parallel_fire_units;
+  }
+
+  static void write_responses(Connection &connection) {
+    while (connection.out_begin < connection.out.size()) {
+      const ssize_t n = ::send(connection.fd, connection.out.data() + connection.out_begin,
+                               connection.out.size() - connection.out_begin, MSG_NOSIGNAL);
+      if (n > 0) {
+        connection.out_begin += static_cast<std::size_t>(n);
+        continue;
+      }
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        connection.closed = true;
+      break;
+    }
+    if (connection.out_begin == connection.out.size()) {
+      connection.out.clear();
+      connection.out_begin = 0;
+    }
+  }
+
+  std::string stats_json() const {
+    auto put_histogram = [](std::ostringstream &out, const LatencyHistogram &histogram) {
+      out << '[';
+      for (std::uint32_t i = 0; i < LatencyHistogram::num_buckets; ++i)
+        out << (i != 0 ? ", " : "") << histogram.counts[i];
+      out << ']';
+    };
+
+    std::ostringstream out;
+    out << "{\n"
+        << "  \"uptime_sec\": " << std::chrono::duration<double>(Clock::now() - stats_.start).count() << ",\n"
+        << "  \"num_threads\": " << pool_.num_threads() << ",\n"
+        << "  \"connections\": " << connections_.size() << ",\n"
+        << "  \"requests\": " << stats_.num_requests << ",\n"
+        << "  \"bad_requests\": " << stats_.num_bad_requests << ",\n"
+        << "  \"battles\": " << stats_.num_battles << ",\n"
+        << "  \"batches\": " << stats_.num_batches << ",\n"
+        << "  \"queued_requests\": " << queue_.size() << ",\n"
+        << "  \"unit_kinds\": [";
+    for (std::uint32_t kind = 0; kind < num_ship_kinds; ++kind)
+      out << (kind != 0 ? ", " : "") << '"' << unit_names[kind] << '"';
+    out << "],\n"
+        << "  \"latency_us\": {\n"
+        << "    \"upper_bounds\": [";
+    for (std::uint32_t i = 0; i + 1 < LatencyHistogram::num_buckets; ++i)
+      out << (i != 0 ? ", " : "") << (std::uint64_t{1} << i);
+    out << ", null],\n"
+        << "    \"queue\": ";
+    put_histogram(out, stats_.queue_latency);
+    out << ",\n"
+        << "    \"total\": ";
+    put_histogram(out, stats_.latency);
+    out << "\n"
+        << "  }\n"
+        << "}\n";
+    return out.str();
+  }
+
+  int listen_fd_;
+  int done_fd_;
+  ThreadPool pool_;
+  std::vector<BattleWorkspace> workspaces_;
+  std::vector<Connection> connections_{};
+  std::uint64_t next_connection_id_ = 0;
+  // Parsed fight requests waiting for a batch, and the replicas x combatants they and the batch hold.
+  std::deque<FightJob> queue_{};
+  std::uint64_t queued_outcomes_ = 0;
+  ServerStats stats_{};
+
+  // Owned by the batch thread from start_batch() until its done_fd_ signal is read by finish_batch().
+  std::vector<FightJob> batch_{};
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> items_{};
+  bool batch_running_ = false;
+
+  std::mutex mutex_;
+  std::condition_variable batch_start_;
+  bool batch_ready_ = false;
+  bool batch_done_ = false;
+  bool stop_ = false;
+  // Last, so that it starts once the rest is constructed.
+  std::thread batch_thread_;
+};
+
+int listen_or_die(const char *path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (std::strlen(path) >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path too long: " << path << '\n';
+    std::exit(1);
+  }
+  std::strcpy(addr.sun_path, path);
+
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    std::cerr << "Failed to create socket: " << std::strerror(errno) << '\n';
+    std::exit(1);
+  }
+
+  // Replace a socket left behind by a server that is gone, but neither a live one nor any other kind of file.
+  struct stat st {};
+  if (::lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    const int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const bool live = ::connect(probe, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0;
+    ::close(probe);
+    if (live) {
+      std::cerr << "Another server is listening on " << path << '\n';
+      std::exit(1);
+    }
+    ::unlink(path);
+  }
+
+  if (::bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+    std::cerr << "Failed to listen on " << path << ": " << std::strerror(errno) << '\n';
+    std::exit(1);
+  }
+  return fd;
+}
+
+} // namespace
+
+int main(int /*argc*/, const char *const *argv) {
+  parse_args(argv);
+
+  const int listen_fd = listen_or_die(opt_socket);
+  struct sigaction action {};
+  action.sa_handler = request_stop;
+  ::sigaction(SIGINT, &action, nullptr);
+  ::sigaction(SIGTERM, &action, nullptr);
+  std::cout << "Listening on " << opt_socket << std::endl;
+
+  const int done_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (done_fd < 0) {
+    std::cerr << "Failed to create an eventfd: " << std::strerror(errno) << '\n';
+    return 1;
+  }
+  {
+    BattleServer server{listen_fd, done_fd};
+    server.run();
+  }
+  ::close(done_fd);
+
+  ::close(listen_fd);
+  ::unlink(opt_socket);
+  return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef DATASET_GEN_BATTLE_SERVER_PROTOCOL_HPP
+#define DATASET_GEN_BATTLE_SERVER_PROTOCOL_HPP
+
+#include <cstdint>
+
+namespace dataset_gen {
+
+// Battle server protocol
+//
+// Clients connect to the Unix domain socket of battle-server and send requests, each a ServerFrameHeader followed by
+// payload_size bytes of payload. The server answers every request with a frame of the same type and request_id.
+// Answers to pipelined requests may come back out of order. All integers are little-endian.
+//
+// Fight request payload: a FightRequestHeader, then num_attackers + num_defenders combatants, attackers first. Each
+// combatant is its weapons, shielding and armor techs and its number of unit groups (4 x uint8), followed by the
+// groups, each a unit kind (uint8) and a number of units (uint32), unaligned. The unit kinds are the ships, those of
+// the stats response; defenses have no attributes yet and make the request bad.
+//
+// Fight response payload: a FightResponseHeader, then the means and then the sample standard deviations of the units
+// left of every combatant over the replicas, double[num_combatants][num_unit_kinds] each.
+//
+// Stats request payload: empty. Stats response payload: JSON text with the counters, the unit kind names and the
+// latency histograms of the server.
+//
+// A frame with a bad magic or a payload larger than server_max_payload_size closes the connection.
+
+constexpr std::uint32_t server_magic = 0x5342474f; // "OGBS"
+constexpr std::uint16_t server_version = 1;
+constexpr std::uint32_t server_max_payload_size = 1 << 20;
+// Combatants per side, as the ACS of the game.
+constexpr std::uint32_t server_max_combatants = 16;
+
+enum class ServerRequestType : std::uint8_t {
+  Fight = 1,
+  Stats = 2,
+};
+
+enum class ServerStatus : std::uint8_t {
+  Ok = 0,
+  // Malformed payload or parameters out of range.
+  BadRequest = 1,
+  // Unknown version or request type.
+  Unsupported = 2,
+};
+
+struct ServerFrameHeader {
+  std::uint32_t magic;
+  std::uint16_t version;
+  std::uint8_t type;
+  // Responses only.
+  std::uint8_t status;
+  std::uint32_t request_id;
+  std::uint32_t payload_size;
+};
+
+struct FightRequestHeader {
+  std::uint32_t num_replicas;
+  // Replica seeds are derived from it, so the same request always gets the same results.
+  std::uint32_t seed;
+  std::uint8_t num_attackers;
+  std::uint8_t num_defenders;
+  std::uint16_t reserved;
+};
+
+struct FightResponseHeader {
+  std::uint32_t num_replicas;
+  std::uint16_t num_combatants;
+  std::uint16_t num_unit_kinds;
+};
+
+static_assert(sizeof(ServerFrameHeader) == 16);
+static_assert(sizeof(FightRequestHeader) == 12);
+static_assert(sizeof(FightResponseHeader) == 8);
+
+} // namespace dataset_gen
+
+#endif // !DATASET_GEN_BATTLE_SERVER_PROTOCOL_HPP
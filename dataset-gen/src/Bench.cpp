@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <latch>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Args.hpp"
+#include "BattleEngine.hpp"
+#include "Random.hpp"
+#include "Topology.hpp"
+#include "UnitGroups.hpp"
+#include "Units.hpp"
+
+using namespace dataset_gen;
+
+namespace {
+
+// Options
+
+const char *opt_scenario = nullptr;
+double opt_min_time = 1.0;
+std::uint32_t opt_batch_size = 16;
+FightOptions opt_fight{};
+std::uint32_t opt_num_threads = 1;
+Affinity opt_affinity = Affinity::None;
+
+// Scenarios
+//
+// Every scenario is a fixed battle fought with a fixed sequence of seeds, so that runs on different commits fight the
+// same battles and can be compared.
+
+struct Scenario {
+  const char *name;
+  std::uint32_t seed;
+  std::vector<Combatant> attackers;
+  std::vector<Combatant> defenders;
+};
+
+Combatant make_combatant(std::uint8_t tech, std::initializer_list<std::pair<UnitKind, std::uint32_t>> units) {
+  Combatant c{};
+  c.techs = {tech, tech, tech};
+  for (auto [kind, count] : units)
+    c.unit_groups[kind] = count;
+  return c;
+}
+
+std::vector<Scenario> make_scenarios() {
+  std::vector<Scenario> scenarios;
+
+  scenarios.push_back({"small_skirmish",
+                       1,
+                       {make_combatant(10, {{LightFighter, 20}, {HeavyFighter, 10}, {Cruiser, 5}})},
+                       {make_combatant(10, {{LightFighter, 15}, {Cruiser, 8}, {Battleship, 3}})}});
+
+  scenarios.push_back({"rapid_fire",
+                       2,
+                       {make_combatant(12, {{Cruiser, 500}, {Battlecruiser, 100}})},
+                       {make_combatant(12, {{LightFighter, 3000}, {EspionageProbe, 500}, {SolarSatellite, 500}})}});
+
+  // 10000 of every ship kind but the Death Star, whose weapons and rapid fire would destroy most of the other ships in
+  // the first round, so that the battle goes on over the rounds with large fleets of every other kind.
+  Combatant all_kinds_attacker = make_combatant(15, {});
+  Combatant all_kinds_defender = make_combatant(15, {});
+  for (std::uint8_t kind = 0; kind <= Battlecruiser; ++kind) {
+    if (kind != DeathStar) {
+      all_kinds_attacker.unit_groups[kind] = 10000;
+      all_kinds_defender.unit_groups[kind] = 10000;
+    }
+  }
+  scenarios.push_back({"fleets_10k", 3, {all_kinds_attacker}, {all_kinds_defender}});
+
+  scenarios.push_back({"lopsided",
+                       4,
+                       {make_combatant(20, {{Battleship, 2000}, {Destroyer, 500}, {Battlecruiser, 500}})},
+                       {make_combatant(5, {{SmallCargo, 300}, {LargeCargo, 100}, {LightFighter, 200}})}});
+
+  scenarios.push_back({"multi_combatant",
+                       5,
+                       {make_combatant(8, {{LightFighter, 400}, {Cruiser, 50}}),
+                        make_combatant(12, {{Battleship, 120}, {Bomber, 30}}),
+                        make_combatant(10, {{HeavyFighter, 200}, {SmallCargo, 100}})},
+                       {make_combatant(11, {{Cruiser, 150}, {Battlecruiser, 40}}),
+                        make_combatant(9, {{LightFighter, 600}, {Destroyer, 10}})}});
+
+  // A million units a side, larger than the caches.
+  const Combatant million_units =
+      make_combatant(15, {{LightFighter, 600000}, {HeavyFighter, 200000}, {Cruiser, 100000}, {Battleship, 100000}});
+  scenarios.push_back({"fleets_1m", 6, {million_units}, {million_units}});
+
+  return scenarios;
+}
+
+template <std::size_t N> std::size_t parse_name_arg_or_die(const char *arg, const char *const (&names)[N],
+                                                           const char *name) {
+  auto it = std::ranges::find_if(names, [&](const char *n) { return arg != nullptr && std::strcmp(n, arg) == 0; });
+  if (it == std::end(names)) {
+    std::cerr << "Failed to parse argument " << name << '\n';
+    std::exit(1);
+  }
+  return static_cast<std::size_t>(it - std::begin(names));
+}
+
+void parse_args(const char *const *argv) {
+  const char *arg0 = *argv++;
+  for (; *argv != nullptr; ++argv) {
+    if (std::strcmp(*argv, "-h") == 0 || std::strcmp(*argv, "--help") == 0) {
+      std::cout << "Usage: " << arg0 << " [OPTIONS]\n"
+                << '\n'
+                << "Fights fixed battles and prints battles/sec, ns/shot and the time per phase as JSON. With several\n"
+                << "threads, every thread fights the battles on its own and the battles/sec of every NUMA node are\n"
+                << "printed too, to show how the throughput scales within and across the nodes. The mean survivors\n"
+                << "of each side and their standard errors are printed to check that engines agree.\n"
+                << '\n'
+                << "Options:\n"
+                << "  --batch-size n    Number of replicas passed to fight_replicas at once (default: 16)\n"
+                << "  --engine name     Battle engine: units, groups, compact or batched (default: units)\n"
+                << "  --lanes n         Lanes of the units engine: 0, 1, 8 or 16 (default: 0)\n"
+                << "  --min-time x      Min number of seconds to run each scenario (default: 1)\n"
+                << "  --num-threads n   Number of threads fighting at once (default: 1)\n"
+                << "  --numa            Bind every thread to the CPUs of a NUMA node, spreading them over the nodes\n"
+                << "  --pin             Pin every thread to a CPU, spreading them over the NUMA nodes\n"
+                << "  --rng name        Battle RNG engine: lehmer, lehmer-fast, lehmer-block, xoshiro128+ or pcg32\n"
+                << "                    (default: lehmer)\n"
+                << "  --scenario name   Run only this scenario (default: all)\n";
+      std::exit(0);
+    } else if (std::strcmp(*argv, "--batch-size") == 0) {
+      opt_batch_size = parse_int_arg_or_die<std::uint32_t>(*++argv, "--batch-size");
+      if (opt_batch_size == 0) {
+        std::cerr << "--batch-size must be at least 1\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--engine") == 0) {
+      opt_fight.engine = static_cast<EngineKind>(parse_name_arg_or_die(*++argv, engine_kind_names, "--engine"));
+    } else if (std::strcmp(*argv, "--lanes") == 0) {
+      opt_fight.lanes = parse_int_arg_or_die<std::uint32_t>(*++argv, "--lanes");
+      if (opt_fight.lanes > 1 && std::ranges::find(replica_lanes, opt_fight.lanes) == std::end(replica_lanes)) {
+        std::cerr << "--lanes must be 0, 1, 8 or 16\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--min-time") == 0) {
+      const char *arg = *++argv;
+      char *end = nullptr;
+      opt_min_time = arg != nullptr ? std::strtod(arg, &end) : -1.0;
+      if (end == arg || *end != '\0' || opt_min_time < 0.0) {
+        std::cerr << "Failed to parse argument --min-time\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--num-threads") == 0) {
+      opt_num_threads = parse_int_arg_or_die<std::uint32_t>(*++argv, "--num-threads");
+      if (opt_num_threads == 0) {
+        std::cerr << "--num-threads must be at least 1\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--numa") == 0) {
+      if (opt_affinity == Affinity::Cpu) {
+        std::cerr << "--numa and --pin cannot be used together\n";
+        std::exit(1);
+      }
+      opt_affinity = Affinity::Node;
+    } else if (std::strcmp(*argv, "--pin") == 0) {
+      if (opt_affinity == Affinity::Node) {
+        std::cerr << "--numa and --pin cannot be used together\n";
+        std::exit(1);
+      }
+      opt_affinity = Affinity::Cpu;
+    } else if (std::strcmp(*argv, "--rng") == 0) {
+      opt_fight.rng = static_cast<RngKind>(parse_name_arg_or_die(*++argv, rng_kind_names, "--rng"));
+    } else if (std::strcmp(*argv, "--scenario") == 0) {
+      opt_scenario = *++argv;
+      if (opt_scenario == nullptr) {
+        std::cerr << "Failed to parse argument --scenario\n";
+        std::exit(1);
+      }
+    } else {
+      std::cerr << "Unknown argument " << *argv << '\n';
+      std::exit(1);
+    }
+  }
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Units left on each side after the battles.
+struct SurvivorStats {
+  std::uint64_t count = 0;
+  double sums[2]{};
+  double squares[2]{};
+
+  void add(const BattleOutcome &outcome) {
+    ++count;
+    const std::span<const UnitGroups<std::uint32_t>> sides[] = {outcome.attackers, outcome.defenders};
+    for (std::size_t side = 0; side < 2; ++side) {
+      double units = 0.0;
+      for (const auto &groups : sides[side]) {
+        for (std::uint32_t n : groups)
+          units += n;
+      }
+      sums[side] += units;
+      squares[side] += units * units;
+    }
+  }
+
+  double mean(std::size_t side) const { return sums[side] / static_cast<double>(count); }
+
+  double standard_error(std::size_t side) const {
+    const double n = static_cast<double>(count);
+    const double variance = (squares[side] - sums[side] * sums[side] / n) / (n - 1.0);
+    return std::sqrt(std::max(variance, 0.0) / n);
+  }
+};
+
+struct ThreadResult {
+  std::uint32_t node = 0;
+  std::vector<std::uint32_t> seeds{};
+  double seconds = 0.0;
+  SurvivorStats survivors{};
+};
+
+struct ScenarioResult {
+  std::uint64_t num_battles = 0;
+  double seconds = 0.0;
+  double battles_per_sec = 0.0;
+  PhaseTimes times{};
+  std::vector<ThreadResult> threads{};
+};
+
+// Fights batches of replicas with the selected engine until --min-time has passed. Thread 0 fights the seeds of the
+// scenario and every other thread its own sequence. The thread places itself before allocating its buffers, so that
+// they are on its node, and starts fighting with the others.
+void fight_batches(const Scenario &scenario, const ThreadPlacement &placement, std::uint32_t thread, std::latch &ready,
+                   ThreadResult &result) {
+  if (!placement.apply(thread)) {
+    std::cerr << "Failed to set the CPU affinity of thread " << thread << '\n';
+    std::exit(1);
+  }
+  result.node = placement.nodes()[placement.node_index(thread)].id;
+
+  BattleWorkspace workspace{};
+  const BattleSpec spec{.attackers = scenario.attackers, .defenders = scenario.defenders};
+
+  std::vector<UnitGroups<std::uint32_t>> attacker_outcomes(opt_batch_size * scenario.attackers.size());
+  std::vector<UnitGroups<std::uint32_t>> defender_outcomes(opt_batch_size * scenario.defenders.size());
+  std::vector<BattleOutcome> outcomes(opt_batch_size);
+  for (std::uint32_t i = 0; i < opt_batch_size; ++i) {
+    outcomes[i].attackers = std::span{attacker_outcomes}.subspan(i * scenario.attackers.size(),
+                                                                 scenario.attackers.size());
+    outcomes[i].defenders = std::span{defender_outcomes}.subspan(i * scenario.defenders.size(),
+                                                                 scenario.defenders.size());
+  }
+
+  std::vector<std::uint32_t> &seeds = result.seeds;
+
+  ready.arrive_and_wait();
+  const auto start = std::chrono::steady_clock::now();
+  do {
+    const std::size_t begin = seeds.size();
+    // Every replica is seeded from a RowRng of its own, as the rows of dataset-gen. Consecutive numbers of one Lehmer
+    // engine would make every replica fight the sequence of the previous one shifted by a number.
+    for (std::uint32_t i = 0; i < opt_batch_size; ++i)
+      seeds.push_back(RowRng{scenario.seed, (std::uint64_t{thread} << 32) + seeds.size()}());
+    fight_replicas(workspace, spec, std::span{seeds}.subspan(begin), outcomes, opt_fight);
+    for (const BattleOutcome &outcome : outcomes)
+      result.survivors.add(outcome);
+  } while (seconds_since(start) < opt_min_time);
+  result.seconds = seconds_since(start);
+}
+
+// Fights the battles on all the threads, then the battles of thread 0 again with fight_timed() for the shots and the
+// time per phase.
+ScenarioResult run_scenario(const Scenario &scenario, const ThreadPlacement &placement) {
+  ScenarioResult result{};
+  result.threads.resize(opt_num_threads);
+
+  std::latch ready{opt_num_threads};
+  std::vector<std::thread> threads;
+  for (std::uint32_t thread = 0; thread < opt_num_threads; ++thread) {
+    threads.emplace_back(fight_batches, std::cref(scenario), std::cref(placement), thread, std::ref(ready),
+                         std::ref(result.threads[thread]));
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  for (const ThreadResult &thread : result.threads) {
+    result.num_battles += thread.seeds.size();
+    result.seconds = std::max(result.seconds, thread.seconds);
+    result.battles_per_sec += static_cast<double>(thread.seeds.size()) / thread.seconds;
+  }
+
+  BattleWorkspace workspace{};
+  const BattleSpec spec{.attackers = scenario.attackers, .defenders = scenario.defenders};
+  std::vector<UnitGroups<std::uint32_t>> attacker_outcomes(scenario.attackers.size());
+  std::vector<UnitGroups<std::uint32_t>> defender_outcomes(scenario.defenders.size());
+  BattleOutcome outcome{.attackers = attacker_outcomes, .defenders = defender_outcomes};
+  with_rng(opt_fight.rng, [&]<typename Rng>(std::type_identity<Rng>) {
+    for (std::uint32_t seed : result.threads[0].seeds)
+      fight_timed<Rng>(workspace, spec, seed, outcome, result.times);
+  });
+
+  return result;
+}
+
+// The battles/sec are summed over the threads; the other figures are those of thread 0.
+void print_result(const Scenario &scenario, const ScenarioResult &result, const ThreadPlacement &placement,
+                  bool last) {
+  const ThreadResult &first = result.threads[0];
+  const double battles = static_cast<double>(first.seeds.size());
+  std::cout << "    {\n"
+            << "      \"name\": \"" << scenario.name << "\",\n"
+            << "      \"battles\": " << result.num_battles << ",\n"
+            << "      \"seconds\": " << result.seconds << ",\n"
+            << "      \"battles_per_sec\": " << result.battles_per_sec << ",\n"
+            << "      \"shots_per_battle\": " << static_cast<double>(result.times.shots) / battles << ",\n"
+            << "      \"rounds_per_battle\": " << static_cast<double>(result.times.rounds) / battles << ",\n"
+            << "      \"ns_per_shot\": " << first.seconds * 1e9 / static_cast<double>(result.times.shots) << ",\n"
+            << "      \"survivors\": {\"attackers\": {\"mean\": " << first.survivors.mean(0)
+            << ", \"se\": " << first.survivors.standard_error(0) << "}, \"defenders\": {\"mean\": "
+            << first.survivors.mean(1) << ", \"se\": " << first.survivors.standard_error(1) << "}},\n";
+  if (opt_num_threads > 1) {
+    std::cout << "      \"nodes\": [";
+    for (std::size_t i = 0; i < placement.nodes().size(); ++i) {
+      std::uint32_t num_threads = 0;
+      double battles_per_sec = 0.0;
+      for (const ThreadResult &thread : result.threads) {
+        if (thread.node == placement.nodes()[i].id) {
+          ++num_threads;
+          battles_per_sec += static_cast<double>(thread.seeds.size()) / thread.seconds;
+        }
+      }
+      std::cout << (i != 0 ? ", " : "") << "{\"node\": " << placement.nodes()[i].id << ", \"threads\": " << num_threads
+                << ", \"battles_per_sec\": " << battles_per_sec << '}';
+    }
+    std::cout << "],\n";
+  }
+  std::cout << "      \"phase_ns_per_battle\": {";
+  for (std::size_t phase = 0; phase < num_battle_phases; ++phase) {
+    std::cout << (phase != 0 ? ", " : "") << '"' << battle_phase_names[phase]
+              << "\": " << static_cast<double>(result.times.ns[phase]) / battles;
+  }
+  std::cout << "}\n"
+            << "    }" << (last ? "" : ",") << '\n';
+}
+
+} // namespace
+
+int main(int /*argc*/, const char *const *argv) {
+  parse_args(argv);
+
+  std::vector<Scenario> scenarios = make_scenarios();
+  if (opt_scenario != nullptr) {
+    std::erase_if(scenarios, [](const Scenario &s) { return std::strcmp(s.name, opt_scenario) != 0; });
+    if (scenarios.empty()) {
+      std::cerr << "Unknown scenario " << opt_scenario << '\n';
+      return 1;
+    }
+  }
+
+  const ThreadPlacement placement{opt_affinity, opt_num_threads};
+
+  std::cout << "{\n"
+            << "  \"rng\": \"" << rng_kind_names[static_cast<std::size_t>(opt_fight.rng)] << "\",\n"
+            << "  \"engine\": \"" << engine_kind_names[static_cast<std::size_t>(opt_fight.engine)] << "\",\n"
+            << "  \"lanes\": " << opt_fight.lanes << ",\n"
+            << "  \"batch_size\": " << opt_batch_size << ",\n"
+            << "  \"num_threads\": " << opt_num_threads << ",\n"
+            << "  \"affinity\": \"" << affinity_names[static_cast<std::size_t>(opt_affinity)] << "\",\n"
+            << "  \"scenarios\": [\n";
+  for (std::size_t i = 0; i < scenarios.size(); ++i)
+    print_result(scenarios[i], run_scenario(scenarios[i], placement), placement, i + 1 == scenarios.size());
+  std::cout << "  ]\n"
+            << "}\n";
+
+  return 0;
+}
@@ -1,19 +1,36 @@
+#include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cassert>
 #include <charconv>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <numeric>
 #include <random>
+#include <span>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
 
+#include "Args.hpp"
 #include "BattleEngine.hpp"
+#include "DatasetWriter.hpp"
+#include "OrderedQueue.hpp"
+#include "Random.hpp"
+#include "RunningStats.hpp"
+#include "Topology.hpp"
 #include "UnitGroups.hpp"
+#include "Units.hpp"
 #include "Util.hpp"
 
 using namespace dataset_gen;
@@ -23,21 +40,55 @@ namespace {
 // Options
 
 const char *opt_out = "dataset";
+DatasetFormat opt_format = DatasetFormat::Csv;
+std::uint32_t opt_csv_precision = default_csv_precision;
 
 std::uint32_t opt_dataset_size = 1000;
-std::uint32_t opt_smooth_size = 100;
+// Rows [opt_row_begin, opt_row_end) of the dataset are generated, set from --row-range or --shard.
+std::uint32_t opt_row_begin = 0;
+std::uint32_t opt_row_end = 0;
+bool opt_row_range = false;
+std::uint32_t opt_shard_index = 0;
+std::uint32_t opt_num_shards = 0;
+std::uint32_t opt_smooth_min = 100;
+std::uint32_t opt_smooth_max = 100;
+double opt_rel_se = 0.0;
+
+enum class SamplerKind { Uniform, Weighted };
+constexpr const char *sampler_kind_names[] = {"uniform", "weighted"};
+SamplerKind opt_sampler = SamplerKind::Uniform;
+const char *opt_error_map = nullptr;
 
 std::uint32_t opt_max_ships = 10000;
 std::uint8_t opt_max_tech = 30;
 
 std::uint32_t opt_num_threads = 0;
+Affinity opt_affinity = Affinity::None;
 std::uint32_t opt_seed = 0;
+RngKind opt_rng = RngKind::Lehmer;
+std::uint32_t opt_lanes = 0;
+EngineKind opt_engine = EngineKind::Units;
 
-template <typename T> T parse_int_arg_or_die(const char *arg, const char *name) {
+std::uint32_t opt_chunk_size = 100;
+std::uint32_t opt_queue_depth = 4;
+
+double opt_checkpoint_interval = 60.0;
+bool opt_resume = false;
+
+bool opt_stats = false;
+
+// Parses "<a><separator><b>".
+template <typename T> std::pair<T, T> parse_int_pair_arg_or_die(const char *arg, char separator, const char *name) {
   if (arg != nullptr) {
-    T result;
-    if (auto [_, ec] = std::from_chars(arg, arg + std::strlen(arg), result); ec == std::errc())
-      return result;
+    const char *end = arg + std::strlen(arg);
+    T a;
+    T b;
+    auto [sep, ec] = std::from_chars(arg, end, a);
+    if (ec == std::errc() && sep != end && *sep == separator) {
+      auto [last, ec2] = std::from_chars(sep + 1, end, b);
+      if (ec2 == std::errc() && last == end)
+        return {a, b};
+    }
   }
   std::cerr << "Failed to parse argument " << name << '\n';
   std::exit(1);
@@ -50,50 +101,362 @@ void parse_args(const char *const *argv) {
       std::cout << "Usage: " << arg0 << " [OPTIONS]\n"
                 << '\n'
                 << "Options:\n"
+                << "  --checkpoint-interval x\n"
+                << "                    Seconds between checkpoints: the rows written so far are flushed to the\n"
+                << "                    disk and recorded in <out>.checkpoint with the options, for --resume. 0 to\n"
+                << "                    disable (default: 60)\n"
+                << "  --chunk-size n    Number of rows a worker claims and hands to the writer at once (default: 100)\n"
+                << "  --csv-precision n Significant digits of the CSV values, up to 17, or 0 for the fewest that read\n"
+                << "                    back as the same value (default: 6)\n"
                 << "  --dataset-size n  Dataset size (default: 1000)\n"
+                << "  --engine name     Battle engine: units, or groups to store the units not hit as counts, faster\n"
+                << "                    with large fleets, without changing the dataset; or compact to pack a unit in\n"
+                << "                    8 bytes, faster with fleets larger than the caches, rounding hulls to 0.001;\n"
+                << "                    or batched to apply the shots of a round sorted by target, faster with\n"
+                << "                    fleets larger than the caches (default: units)\n"
+                << "  --error-map path  Region error map of the weighted sampler, as written by export-error-map.py\n"
+                << "  --format f        Output format, csv or binary (default: csv)\n"
+                << "  --lanes n         Number of replicas of a battle fought at once in lockstep: 1, 8 or 16, or 0\n"
+                << "                    to pick it for the engine and CPU. Does not change the dataset (default: 0)\n"
                 << "  --max-ships n     Max number of ships in one unit group in one battle (default: 10000)\n"
                 << "  --max-tech n      Max tech of a combatant (default: 30)\n"
                 << "  --num-threads n   Number of threads, 0 for number of available CPUs (default: 0)\n"
+                << "  --numa            Bind every worker thread to the CPUs of a NUMA node, spreading the threads\n"
+                << "                    over the nodes\n"
                 << "  --out path        Output path for the generated dataset (default: dataset)\n"
-                << "  --seed n          Seed, 0 to randomly generate (default: 0)\n"
-                << "  --smooth-size n   Smooth size (default: 100)\n";
+                << "  --pin             Pin every worker thread to a CPU, spreading the threads over the NUMA nodes\n"
+                << "  --queue-depth n   Max number of finished chunks waiting to be written per worker (default: 4)\n"
+                << "  --rel-se x        Stop smoothing a row once the standard error of every mean is at most x times\n"
+                << "                    the mean, 0 to always run --smooth-max battles (default: 0)\n"
+                << "  --resume          Go on with an interrupted run from its checkpoint. The options that change\n"
+                << "                    the dataset must be the same; the seed is taken from the checkpoint if not\n"
+                << "                    given\n"
+                << "  --rng name        Battle RNG engine: lehmer, lehmer-fast, lehmer-block, xoshiro128+ or pcg32;\n"
+                << "                    the lehmer engines give the same datasets (default: lehmer)\n"
+                << "  --row-range a:b   Generate only rows [a, b) of the dataset; needs --seed\n"
+                << "  --sampler name    How the battles of the rows are drawn: uniform, or weighted to draw them in\n"
+                << "                    proportion to the model error of their region in --error-map, writing their\n"
+                << "                    importance weights in a weight column (default: uniform)\n"
+                << "  --seed n          Seed, 0 to randomly generate (default: 0). Every row is generated from the\n"
+                << "                    seed and its index, so the dataset does not depend on the threads or chunks\n"
+                << "  --shard i/N       Generate only the i-th of N equal parts of the dataset, i from 0; needs\n"
+                << "                    --seed. Join the parts with dataset-merge\n"
+                << "  --smooth-max n    Max number of battles per row (default: 100)\n"
+                << "  --smooth-min n    Min number of battles per row, and the number of battles between the --rel-se\n"
+                << "                    checks (default: 100)\n"
+                << "  --smooth-size n   Number of battles per row, sets both --smooth-min and --smooth-max\n"
+                << "  --stats           Print the battle engine counters, needs a DATASET_GEN_ENABLE_STATS build\n";
       std::exit(0);
     }
 
-    if (std::strcmp(*argv, "--dataset-size") == 0) {
+    if (std::strcmp(*argv, "--checkpoint-interval") == 0) {
+      const char *arg = *++argv;
+      char *end = nullptr;
+      opt_checkpoint_interval = arg != nullptr ? std::strtod(arg, &end) : -1.0;
+      if (end == arg || *end != '\0' || opt_checkpoint_interval < 0.0) {
+        std::cerr << "Failed to parse argument --checkpoint-interval\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--chunk-size") == 0) {
+      opt_chunk_size = parse_int_arg_or_die<std::uint32_t>(*++argv, "--chunk-size");
+      if (opt_chunk_size == 0) {
+        std::cerr << "--chunk-size must be at least 1\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--csv-precision") == 0) {
+      opt_csv_precision = parse_int_arg_or_die<std::uint32_t>(*++argv, "--csv-precision");
+      if (opt_csv_precision > max_csv_precision) {
+        std::cerr << "--csv-precision must be at most " << max_csv_precision << '\n';
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--dataset-size") == 0) {
       opt_dataset_size = parse_int_arg_or_die<std::uint32_t>(*++argv, "--dataset-size");
+    } else if (std::strcmp(*argv, "--engine") == 0) {
+      const char *name = *++argv;
+      auto it = std::ranges::find_if(engine_kind_names,
+                                     [&](const char *n) { return name != nullptr && std::strcmp(n, name) == 0; });
+      if (it == std::end(engine_kind_names)) {
+        std::cerr << "--engine must be units, groups, compact or batched\n";
+        std::exit(1);
+      }
+      opt_engine = static_cast<EngineKind>(it - std::begin(engine_kind_names));
+    } else if (std::strcmp(*argv, "--error-map") == 0) {
+      opt_error_map = *++argv;
+      if (opt_error_map == nullptr) {
+        std::cerr << "Failed to parse argument --error-map\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--format") == 0) {
+      const char *format = *++argv;
+      if (format != nullptr && std::strcmp(format, "csv") == 0) {
+        opt_format = DatasetFormat::Csv;
+      } else if (format != nullptr && std::strcmp(format, "binary") == 0) {
+        opt_format = DatasetFormat::Binary;
+      } else {
+        std::cerr << "--format must be csv or binary\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--lanes") == 0) {
+      opt_lanes = parse_int_arg_or_die<std::uint32_t>(*++argv, "--lanes");
+      if (opt_lanes > 1 && std::ranges::find(replica_lanes, opt_lanes) == std::end(replica_lanes)) {
+        std::cerr << "--lanes must be 0, 1, 8 or 16\n";
+        std::exit(1);
+      }
     } else if (std::strcmp(*argv, "--max-ships") == 0) {
       opt_max_ships = parse_int_arg_or_die<std::uint32_t>(*++argv, "--max-ships");
     } else if (std::strcmp(*argv, "--max-tech") == 0) {
       opt_max_tech = parse_int_arg_or_die<std::uint8_t>(*++argv, "--max-tech");
     } else if (std::strcmp(*argv, "--num-threads") == 0) {
       opt_num_threads = parse_int_arg_or_die<std::uint32_t>(*++argv, "--num-threads");
+    } else if (std::strcmp(*argv, "--numa") == 0) {
+      if (opt_affinity == Affinity::Cpu) {
+        std::cerr << "--numa and --pin cannot be used together\n";
+        std::exit(1);
+      }
+      opt_affinity = Affinity::Node;
     } else if (std::strcmp(*argv, "--out") == 0) {
-      opt_out = *argv;
+      opt_out = *++argv;
+      if (opt_out == nullptr) {
+        std::cerr << "Failed to parse argument --out\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--pin") == 0) {
+      if (opt_affinity == Affinity::Node) {
+        std::cerr << "--numa and --pin cannot be used together\n";
+        std::exit(1);
+      }
+      opt_affinity = Affinity::Cpu;
+    } else if (std::strcmp(*argv, "--queue-depth") == 0) {
+      opt_queue_depth = parse_int_arg_or_die<std::uint32_t>(*++argv, "--queue-depth");
+      if (opt_queue_depth == 0) {
+        std::cerr << "--queue-depth must be at least 1\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--row-range") == 0) {
+      std::tie(opt_row_begin, opt_row_end) = parse_int_pair_arg_or_die<std::uint32_t>(*++argv, ':', "--row-range");
+      opt_row_range = true;
+    } else if (std::strcmp(*argv, "--resume") == 0) {
+      opt_resume = true;
+    } else if (std::strcmp(*argv, "--rel-se") == 0) {
+      const char *arg = *++argv;
+      char *end = nullptr;
+      opt_rel_se = arg != nullptr ? std::strtod(arg, &end) : -1.0;
+      if (end == arg || *end != '\0' || opt_rel_se < 0.0) {
+        std::cerr << "Failed to parse argument --rel-se\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--rng") == 0) {
+      const char *name = *++argv;
+      auto it = std::ranges::find_if(rng_kind_names,
+                                     [&](const char *n) { return name != nullptr && std::strcmp(n, name) == 0; });
+      if (it == std::end(rng_kind_names)) {
+        std::cerr << "--rng must be lehmer, lehmer-fast, lehmer-block, xoshiro128+ or pcg32\n";
+        std::exit(1);
+      }
+      opt_rng = static_cast<RngKind>(it - std::begin(rng_kind_names));
+    } else if (std::strcmp(*argv, "--sampler") == 0) {
+      const char *name = *++argv;
+      auto it = std::ranges::find_if(sampler_kind_names,
+                                     [&](const char *n) { return name != nullptr && std::strcmp(n, name) == 0; });
+      if (it == std::end(sampler_kind_names)) {
+        std::cerr << "--sampler must be uniform or weighted\n";
+        std::exit(1);
+      }
+      opt_sampler = static_cast<SamplerKind>(it - std::begin(sampler_kind_names));
     } else if (std::strcmp(*argv, "--seed") == 0) {
       opt_seed = parse_int_arg_or_die<std::uint32_t>(*++argv, "--seed");
+    } else if (std::strcmp(*argv, "--shard") == 0) {
+      std::tie(opt_shard_index, opt_num_shards) = parse_int_pair_arg_or_die<std::uint32_t>(*++argv, '/', "--shard");
+      if (opt_shard_index >= opt_num_shards) {
+        std::cerr << "--shard i/N needs i < N\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--smooth-max") == 0) {
+      opt_smooth_max = parse_int_arg_or_die<std::uint32_t>(*++argv, "--smooth-max");
+    } else if (std::strcmp(*argv, "--smooth-min") == 0) {
+      opt_smooth_min = parse_int_arg_or_die<std::uint32_t>(*++argv, "--smooth-min");
     } else if (std::strcmp(*argv, "--smooth-size") == 0) {
-      opt_smooth_size = parse_int_arg_or_die<std::uint32_t>(*++argv, "--smooth-size");
-      if (opt_smooth_size <= 1) {
-        std::cerr << "--smooth-size must be at least 2\n";
+      opt_smooth_min = parse_int_arg_or_die<std::uint32_t>(*++argv, "--smooth-size");
+      opt_smooth_max = opt_smooth_min;
+    } else if (std::strcmp(*argv, "--stats") == 0) {
+      if (!engine_stats_enabled) {
+        std::cerr << "--stats needs dataset-gen built with -DDATASET_GEN_ENABLE_STATS=On\n";
         std::exit(1);
       }
+      opt_stats = true;
     } else {
       std::cerr << "Unknown argument " << *argv << '\n';
       std::exit(1);
     }
   }
+
+  if (opt_smooth_min <= 1) {
+    std::cerr << "--smooth-min and --smooth-size must be at least 2\n";
+    std::exit(1);
+  }
+  if (opt_smooth_max < opt_smooth_min) {
+    std::cerr << "--smooth-max must be at least --smooth-min\n";
+    std::exit(1);
+  }
+
+  if ((opt_sampler == SamplerKind::Weighted) != (opt_error_map != nullptr)) {
+    std::cerr << "--sampler weighted needs an --error-map, and only it\n";
+    std::exit(1);
+  }
+
+  if (opt_row_range && opt_num_shards != 0) {
+    std::cerr << "--row-range and --shard cannot be used together\n";
+    std::exit(1);
+  }
+  if ((opt_row_range || opt_num_shards != 0) && opt_seed == 0 && !opt_resume) {
+    std::cerr << "--row-range and --shard need a --seed, the same for all the parts\n";
+    std::exit(1);
+  }
+  if (opt_num_shards != 0) {
+    opt_row_begin = static_cast<std::uint32_t>(std::uint64_t{opt_dataset_size} * opt_shard_index / opt_num_shards);
+    opt_row_end = static_cast<std::uint32_t>(std::uint64_t{opt_dataset_size} * (opt_shard_index + 1) / opt_num_shards);
+  } else if (!opt_row_range) {
+    opt_row_end = opt_dataset_size;
+  }
+  if (opt_row_begin > opt_row_end || opt_row_end > opt_dataset_size) {
+    std::cerr << "--row-range a:b needs a <= b <= --dataset-size\n";
+    std::exit(1);
+  }
 }
 
+std::uint32_t num_rows() { return opt_row_end - opt_row_begin; }
+
+// Rows written by the run interrupted before --resume; generation starts after them.
+std::uint32_t resumed_rows = 0;
+
+std::uint32_t num_rows_to_generate() { return num_rows() - resumed_rows; }
+
+bool adaptive_smoothing() { return opt_rel_se > 0.0 && opt_smooth_max > opt_smooth_min; }
+
 void dump_settings() {
   std::cout << "Settings:\n"
             << "  dataset-path: " << opt_out << '\n'
             << "  dataset-size: " << opt_dataset_size << '\n'
-            << "  smooth-size:  " << opt_smooth_size << '\n'
+            << "  rows:         " << opt_row_begin << ':' << opt_row_end << '\n'
+            << "  format:       " << (opt_format == DatasetFormat::Binary ? "binary" : "csv") << '\n'
+            << "  precision:    " << opt_csv_precision << '\n'
+            << "  smooth-min:   " << opt_smooth_min << '\n'
+            << "  smooth-max:   " << opt_smooth_max << '\n'
+            << "  rel-se:       " << opt_rel_se << '\n'
+            << "  sampler:      " << sampler_kind_names[static_cast<std::size_t>(opt_sampler)] << '\n'
             << "  max-ships:    " << opt_max_ships << '\n'
             << "  max-tech:     " << static_cast<std::uint32_t>(opt_max_tech) << '\n'
             << "  num-threads:  " << opt_num_threads << '\n'
-            << "  seed:         " << opt_seed << '\n';
+            << "  affinity:     " << affinity_names[static_cast<std::size_t>(opt_affinity)] << '\n'
+            << "  chunk-size:   " << opt_chunk_size << '\n'
+            << "  queue-depth:  " << opt_queue_depth << '\n'
+            << "  seed:         " << opt_seed << '\n'
+            << "  rng:          " << rng_kind_names[static_cast<std::size_t>(opt_rng)] << '\n'
+            << "  engine:       " << engine_kind_names[static_cast<std::size_t>(opt_engine)] << '\n'
+            << "  lanes:        " << opt_lanes << '\n'
+            << "  checkpoint:   " << opt_checkpoint_interval << " s\n";
+  if (opt_resume)
+    std::cout << "Resuming after " << resumed_rows << " rows\n";
+}
+
+// Checkpoints
+//
+// <out>.checkpoint is a text file with one "name value" line per option that changes the dataset, then the number of
+// rows written and, for CSV, the number of bytes they take. It is replaced atomically after the rows are flushed to the
+// disk, so it never claims rows the file does not hold, and removed when the dataset is complete.
+
+std::string checkpoint_path() { return std::string{opt_out} + ".checkpoint"; }
+
+// The options that change the rows, other than the seed and the rows: one "name value" line each, also recorded in
+// binary datasets for dataset-merge.
+std::string generation_options() {
+  // The Lehmer engines give the same datasets, and so do the units and groups engines.
+  const bool lehmer = opt_rng == RngKind::Lehmer || opt_rng == RngKind::LehmerFast || opt_rng == RngKind::LehmerBlock;
+  const EngineKind engine = opt_engine == EngineKind::Groups ? EngineKind::Units : opt_engine;
+
+  std::ostringstream out;
+  out << std::setprecision(17) << "smooth-min " << opt_smooth_min << '\n'
+      << "smooth-max " << opt_smooth_max << '\n'
+      << "rel-se " << opt_rel_se << '\n'
+      << "sampler " << sampler_kind_names[static_cast<std::size_t>(opt_sampler)]
+      << (opt_error_map != nullptr ? std::string{" "} + opt_error_map : std::string{}) << '\n'
+      << "max-ships " << opt_max_ships << '\n'
+      << "max-tech " << static_cast<std::uint32_t>(opt_max_tech) << '\n'
+      << "rng " << (lehmer ? "lehmer" : rng_kind_names[static_cast<std::size_t>(opt_rng)]) << '\n'
+      << "engine " << engine_kind_names[static_cast<std::size_t>(engine)] << '\n';
+  return out.str();
+}
+
+std::string checkpoint_options() {
+  std::ostringstream out;
+  out << "dataset-gen-checkpoint 1\n"
+      << "format " << (opt_format == DatasetFormat::Binary ? "binary" : "csv") << '\n'
+      << "csv-precision " << opt_csv_precision << '\n'
+      << "seed " << opt_seed << '\n'
+      << "dataset-size " << opt_dataset_size << '\n'
+      << "rows " << opt_row_begin << ':' << opt_row_end << '\n'
+      << generation_options();
+  return out.str();
+}
+
+bool save_checkpoint(const DatasetCheckpoint &checkpoint) {
+  const std::string path = checkpoint_path();
+  const std::string tmp_path = path + ".tmp";
+  std::ofstream out{tmp_path};
+  out << checkpoint_options() << "rows-written " << checkpoint.num_rows << '\n'
+      << "size " << checkpoint.size << '\n';
+  out.close();
+  return !out.fail() && std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+// Reads the checkpoint of the interrupted run, taking its seed if --seed is not given, and checks its options.
+DatasetCheckpoint load_checkpoint_or_die() {
+  const std::string path = checkpoint_path();
+  std::ifstream in{path};
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(in, line);)
+    lines.push_back(line);
+  if (lines.empty()) {
+    std::cerr << "Failed to read the checkpoint '" << path << "'\n";
+    std::exit(1);
+  }
+
+  if (opt_seed == 0) {
+    for (const std::string &line : lines) {
+      if (line.starts_with("seed "))
+        opt_seed = parse_int_arg_or_die<std::uint32_t>(line.c_str() + 5, "seed of the checkpoint");
+    }
+  }
+
+  std::vector<std::string> expected;
+  const std::string options = checkpoint_options();
+  for (std::size_t begin = 0, end; (end = options.find('\n', begin)) != std::string::npos; begin = end + 1)
+    expected.push_back(options.substr(begin, end - begin));
+
+  if (lines.size() != expected.size() + 2) {
+    std::cerr << "The checkpoint '" << path << "' is not valid\n";
+    std::exit(1);
+  }
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    if (lines[i] != expected[i]) {
+      std::cerr << "The checkpoint '" << path << "' was written with '" << lines[i] << "', not '" << expected[i]
+                << "'\n";
+      std::exit(1);
+    }
+  }
+  if (!lines[expected.size()].starts_with("rows-written ") || !lines[expected.size() + 1].starts_with("size ")) {
+    std::cerr << "The checkpoint '" << path << "' is not valid\n";
+    std::exit(1);
+  }
+
+  DatasetCheckpoint checkpoint{};
+  checkpoint.num_rows = parse_int_arg_or_die<std::uint64_t>(lines[expected.size()].c_str() + 13, "rows-written");
+  checkpoint.size = parse_int_arg_or_die<std::uint64_t>(lines[expected.size() + 1].c_str() + 5, "size");
+  if (checkpoint.num_rows > num_rows()) {
+    std::cerr << "The checkpoint '" << path << "' is not valid\n";
+    std::exit(1);
+  }
+  return checkpoint;
 }
 
 Combatant gen_random_combatant(std::uint32_t random) {
@@ -119,66 +482,372 @@ Combatant gen_random_combatant(std::uint32_t random) {
   return c;
 }
 
-std::atomic<std::uint32_t> progress{};
+// Scenario samplers
+//
+// A sampler draws the combatants of a row from the random numbers of the row. The weighted sampler draws them in
+// proportion to the error of the trained model in their region, read from a map written by export-error-map.py. The
+// regions bin the battles by the total number of ships, the kind with the most ships of each side and the tech gap:
+// keep scenario_region() in sync with export-error-map.py.
+
+struct SampledScenario {
+  // How much more likely the uniform sampler is to draw the scenario than the sampler, up to a constant factor.
+  double weight;
+  // Scenarios drawn, the rejected ones included.
+  std::uint32_t num_draws;
+};
+
+class ScenarioSampler {
+public:
+  virtual ~ScenarioSampler() = default;
 
-struct Result {
-  Combatant attacker;
-  Combatant defender;
-  UnitGroups<double> attacker_mean;
-  UnitGroups<double> defender_mean;
-  UnitGroups<double> attacker_sd;
-  UnitGroups<double> defender_sd;
+  // Draws the attacker and the defender of a row. Must be safe to call from several threads.
+  virtual SampledScenario sample(RowRng &random, Combatant &attacker, Combatant &defender) const = 0;
 };
 
-UnitGroups<double> calc_mean(const std::vector<UnitGroups<double>> &samples) {
-  UnitGroups<double> sum{};
-  for (const auto &sample : samples)
-    sum = sum + sample;
-  return sum / static_cast<double>(opt_smooth_size);
+class UniformSampler final : public ScenarioSampler {
+public:
+  SampledScenario sample(RowRng &random, Combatant &attacker, Combatant &defender) const override {
+    attacker = gen_random_combatant(random());
+    defender = gen_random_combatant(random());
+    return {.weight = 1.0, .num_draws = 1};
+  }
 };
 
-UnitGroups<double> calc_sd(const std::vector<UnitGroups<double>> &samples, const UnitGroups<double> &mean) {
-  UnitGroups<double> sd{};
-  for (const auto &sample : samples) {
-    auto tmp = sample - mean;
-    sd = sd + tmp * tmp;
+// Regions: bit width of the total number of ships (33 values), the kind with the most ships of each side, the first
+// on ties, or num_dataset_kinds without ships, and the tech gap clamped to +-max_region_tech_gap in bins of
+// region_tech_gap_width.
+constexpr std::uint32_t num_region_strengths = 33;
+constexpr std::uint32_t num_region_kinds = num_dataset_kinds + 1;
+constexpr std::int32_t max_region_tech_gap = 30;
+constexpr std::int32_t region_tech_gap_width = 5;
+constexpr std::uint32_t num_region_tech_gaps = 2 * max_region_tech_gap / region_tech_gap_width + 1;
+constexpr std::uint32_t num_regions = num_region_strengths * num_region_kinds * num_region_kinds * num_region_tech_gaps;
+
+std::uint32_t region_index(std::uint32_t strength, std::uint32_t attacker_kind, std::uint32_t defender_kind,
+                           std::uint32_t tech_gap) {
+  return ((strength * num_region_kinds + attacker_kind) * num_region_kinds + defender_kind) * num_region_tech_gaps +
+         tech_gap;
+}
+
+std::uint32_t scenario_region(const Combatant &attacker, const Combatant &defender) {
+  std::uint64_t num_ships = 0;
+  auto main_kind = [&](const Combatant &c) {
+    std::uint32_t main = num_dataset_kinds;
+    for (std::uint32_t kind = 0; kind < num_dataset_kinds; ++kind) {
+      num_ships += c.unit_groups[kind];
+      if (c.unit_groups[kind] != 0 && (main == num_dataset_kinds || c.unit_groups[kind] > c.unit_groups[main]))
+        main = kind;
+    }
+    return main;
+  };
+  const std::uint32_t attacker_kind = main_kind(attacker);
+  const std::uint32_t defender_kind = main_kind(defender);
+
+  auto tech_sum = [](const CombatTechs &techs) { return std::int32_t{techs.weapons} + techs.shielding + techs.armor; };
+  const std::int32_t tech_gap =
+      std::clamp(tech_sum(attacker.techs) - tech_sum(defender.techs), -max_region_tech_gap, max_region_tech_gap);
+  return region_index(static_cast<std::uint32_t>(std::bit_width(num_ships)), attacker_kind, defender_kind,
+                      static_cast<std::uint32_t>((tech_gap + max_region_tech_gap) / region_tech_gap_width));
+}
+
+// Draws the uniform scenarios and keeps them with a probability proportional to the error of their region (rejection
+// sampling), so that the rows stay a function of their index. Errors below min_relative_region_error times the mean
+// error are raised to it, which bounds the importance weights, and regions missing from the map take the mean error.
+class WeightedSampler final : public ScenarioSampler {
+public:
+  static constexpr double min_relative_region_error = 0.1;
+
+  // The map is a "dataset-gen-error-map 1" line followed by "strength attacker-kind defender-kind tech-gap rows
+  // error" lines, one per region; rows is the number of rows of the region in the dataset the errors come from.
+  explicit WeightedSampler(const char *path) : errors_(num_regions, 0.0) {
+    std::ifstream in{path};
+    std::string line;
+    if (!std::getline(in, line) || line != "dataset-gen-error-map 1") {
+      std::cerr << "Failed to read the error map '" << path << "'\n";
+      std::exit(1);
+    }
+
+    std::vector<bool> known(num_regions);
+    double rows_sum = 0.0;
+    double error_sum = 0.0;
+    while (std::getline(in, line)) {
+      std::istringstream fields{line};
+      std::uint32_t strength;
+      std::uint32_t attacker_kind;
+      std::uint32_t defender_kind;
+      std::uint32_t tech_gap;
+      double rows;
+      double error;
+      if (!(fields >> strength >> attacker_kind >> defender_kind >> tech_gap >> rows >> error) ||
+          strength >= num_region_strengths || attacker_kind >= num_region_kinds ||
+          defender_kind >= num_region_kinds || tech_gap >= num_region_tech_gaps || !(rows >= 0.0) || !(error >= 0.0)) {
+        std::cerr << "Invalid line in the error map '" << path << "': " << line << '\n';
+        std::exit(1);
+      }
+      const std::uint32_t region = region_index(strength, attacker_kind, defender_kind, tech_gap);
+      errors_[region] = error;
+      known[region] = true;
+      rows_sum += rows;
+      error_sum += rows * error;
+    }
+    if (!(error_sum > 0.0)) {
+      std::cerr << "The error map '" << path << "' has no rows with an error\n";
+      std::exit(1);
+    }
+
+    mean_error_ = error_sum / rows_sum;
+    for (std::uint32_t region = 0; region < num_regions; ++region) {
+      errors_[region] =
+          known[region] ? std::max(errors_[region], min_relative_region_error * mean_error_) : mean_error_;
+      max_error_ = std::max(max_error_, errors_[region]);
+    }
+  }
+
+  SampledScenario sample(RowRng &random, Combatant &attacker, Combatant &defender) const override {
+    for (std::uint32_t num_draws = 1;; ++num_draws) {
+      attacker = gen_random_combatant(random());
+      defender = gen_random_combatant(random());
+      const double error = errors_[scenario_region(attacker, defender)];
+      if (static_cast<double>(random()) < error / max_error_ * 4294967296.0)
+        return {.weight = mean_error_ / error, .num_draws = num_draws};
+    }
+  }
+
+private:
+  std::vector<double> errors_;
+  double mean_error_ = 0.0;
+  double max_error_ = 0.0;
+};
+
+std::unique_ptr<ScenarioSampler> make_scenario_sampler() {
+  switch (opt_sampler) {
+  case SamplerKind::Uniform:
+    return std::make_unique<UniformSampler>();
+  case SamplerKind::Weighted:
+    return std::make_unique<WeightedSampler>(opt_error_map);
   }
-  return sq_root(sd / static_cast<double>(opt_smooth_size - 1));
+  return nullptr;
+}
+
+std::atomic<std::uint32_t> progress{};
+
+// Rows are produced in chunks of consecutive rows. Workers claim the next chunk from a shared counter whenever they
+// finish one, so all of them stay busy until the last chunks, however uneven the battles are. Every row draws its
+// random numbers from a RowRng of the global seed and the row index, which keeps the output independent of the
+// threads, the chunks and the scheduling, and lets any range of rows be generated separately. Finished chunks go
+// through an ordered queue to the writer, which serializes them in order. The workers also encode their chunks for the
+// writer, so that the writer thread only writes.
+
+struct Chunk {
+  std::vector<Result> rows;
+  std::vector<char> encoded;
+};
+
+using ChunkQueue = OrderedQueue<Chunk>;
+
+struct WorkerStats {
+  std::uint32_t node = 0;
+  std::uint32_t num_chunks = 0;
+  std::uint32_t num_rows = 0;
+  std::uint64_t num_battles = 0;
+  // Rows whose battles were not fought, see is_trivial_battle().
+  std::uint32_t num_trivial_rows = 0;
+  // Scenarios drawn by the sampler, the rejected ones included.
+  std::uint64_t num_scenarios = 0;
+  double busy_seconds = 0.0;
+  double wait_seconds = 0.0;
+  EngineStats engine{};
+};
+
+std::atomic<std::uint32_t> next_chunk{};
+
+std::uint32_t num_chunks() { return (num_rows_to_generate() + opt_chunk_size - 1) / opt_chunk_size; }
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
-void worker(Result *results, std::uint32_t size, std::uint32_t seed) {
-  auto rng = std::mt19937{seed};
-  auto random = [&] { return static_cast<std::uint32_t>(rng()); };
+// The worker places itself first, so that its workspace and its chunks are first touched, and allocated, on its node.
+void worker(const ThreadPlacement *placement, std::uint32_t thread, const ScenarioSampler *sampler,
+            const DatasetWriter *writer, ChunkQueue *queue, WorkerStats *stats) {
+  if (!placement->apply(thread)) {
+    std::cerr << "Failed to set the CPU affinity of worker " << thread << '\n';
+    std::exit(1);
+  }
+  stats->node = placement->nodes()[placement->node_index(thread)].id;
+
+  BattleWorkspace workspace{};
+  Combatant attacker{};
+  Combatant defender{};
+  const BattleSpec spec{.attackers = {&attacker, 1}, .defenders = {&defender, 1}};
+  std::vector<std::uint32_t> seeds(opt_smooth_max);
+  std::vector<UnitGroups<std::uint32_t>> attacker_outcomes(opt_smooth_max);
+  std::vector<UnitGroups<std::uint32_t>> defender_outcomes(opt_smooth_max);
+  std::vector<BattleOutcome> outcomes(opt_smooth_max);
+  for (std::uint32_t j = 0; j < opt_smooth_max; ++j)
+    outcomes[j] = BattleOutcome{.attackers = {&attacker_outcomes[j], 1}, .defenders = {&defender_outcomes[j], 1}};
+
+  for (;;) {
+    std::uint32_t chunk_id = next_chunk.fetch_add(1, std::memory_order_relaxed);
+    if (chunk_id >= num_chunks())
+      break;
+
+    auto busy_start = std::chrono::steady_clock::now();
+
+    const std::uint32_t begin = chunk_id * opt_chunk_size;
+    Chunk chunk{.rows = std::vector<Result>(std::min(opt_chunk_size, num_rows_to_generate() - begin)), .encoded = {}};
+
+    for (std::uint32_t i = 0; i < chunk.rows.size(); ++i) {
+      Result &res = chunk.rows[i];
+      RowRng random{opt_seed, std::uint64_t{opt_row_begin} + resumed_rows + begin + i};
+
+      const SampledScenario scenario = sampler->sample(random, attacker, defender);
+      stats->num_scenarios += scenario.num_draws;
+
+      RunningStats attacker_stats{};
+      RunningStats defender_stats{};
+      std::uint32_t num_replicas = 0;
+      if (is_trivial_battle(spec)) {
+        // Every replica would end with the units the battle started with. The stats take as many replicas as the
+        // battles would, one block as it converges at once, so that the row is the same as if they were fought.
+        num_replicas = opt_rel_se > 0.0 ? std::min(opt_smooth_min, opt_smooth_max) : opt_smooth_max;
+        for (std::uint32_t j = 0; j < num_replicas; ++j) {
+          attacker_stats.add(attacker.unit_groups);
+          defender_stats.add(defender.unit_groups);
+        }
+        ++stats->num_trivial_rows;
+      } else {
+        // Battles are fought in blocks of --smooth-min, until --smooth-max or until the means are precise enough.
+        do {
+          const std::uint32_t block = std::min(opt_smooth_min, opt_smooth_max - num_replicas);
+          for (std::uint32_t j = 0; j < block; ++j)
+            seeds[j] = random();
+          fight_replicas(workspace, spec, std::span{seeds}.first(block), std::span{outcomes}.first(block),
+                         {.rng = opt_rng, .engine = opt_engine, .lanes = opt_lanes});
+
+          for (std::uint32_t j = 0; j < block; ++j) {
+            attacker_stats.add(attacker_outcomes[j]);
+            defender_stats.add(defender_outcomes[j]);
+          }
+          num_replicas += block;
+          stats->num_battles += block;
+        } while (num_replicas < opt_smooth_max &&
+                 !(opt_rel_se > 0.0 && attacker_stats.converged(opt_rel_se) && defender_stats.converged(opt_rel_se)));
+      }
+
+      res.attacker = attacker;
+      res.defender = defender;
+      res.attacker_mean = attacker_stats.mean;
+      res.defender_mean = defender_stats.mean;
+      res.attacker_sd = attacker_stats.sd();
+      res.defender_sd = defender_stats.sd();
+      res.num_replicas = num_replicas;
+      res.weight = scenario.weight;
 
-  std::vector<UnitGroups<double>> attacker_samples(opt_smooth_size);
-  std::vector<UnitGroups<double>> defender_samples(opt_smooth_size);
+      progress.fetch_add(1, std::memory_order_relaxed);
+    }
 
-  std::vector<Combatant> attackers(1);
-  std::vector<Combatant> defenders(1);
+    writer->encode(chunk.rows.data(), chunk.rows.size(), chunk.encoded);
 
-  for (std::uint32_t i = 0; i < size; ++i) {
-    auto attacker = gen_random_combatant(random());
-    auto defender = gen_random_combatant(random());
+    ++stats->num_chunks;
+    stats->num_rows += static_cast<std::uint32_t>(chunk.rows.size());
+    stats->busy_seconds += seconds_since(busy_start);
 
-    for (std::uint32_t j = 0; j < opt_smooth_size; ++j) {
-      attackers[0] = attacker;
-      defenders[0] = defender;
+    auto wait_start = std::chrono::steady_clock::now();
+    queue->push(chunk_id, std::move(chunk));
+    stats->wait_seconds += seconds_since(wait_start);
+  }
 
-      fight(attackers, defenders, random());
+  stats->engine = workspace.stats;
+}
 
-      attacker_samples[j] = convert<double, std::uint32_t>(attackers[0].unit_groups);
-      defender_samples[j] = convert<double, std::uint32_t>(defenders[0].unit_groups);
+void write_chunks(DatasetWriter *writer, ChunkQueue *queue, bool *ok) {
+  *ok = true;
+  auto last_checkpoint = std::chrono::steady_clock::now();
+  for (std::uint32_t chunk_id = 0; chunk_id < num_chunks(); ++chunk_id) {
+    Chunk chunk = queue->pop();
+    // Keep draining the queue after a failure, otherwise the workers would block forever.
+    if (*ok)
+      *ok = writer->write(chunk.rows.data(), chunk.rows.size(), chunk.encoded);
+
+    if (*ok && opt_checkpoint_interval > 0.0 && seconds_since(last_checkpoint) >= opt_checkpoint_interval) {
+      DatasetCheckpoint checkpoint{};
+      *ok = writer->sync(checkpoint) && save_checkpoint(checkpoint);
+      last_checkpoint = std::chrono::steady_clock::now();
     }
+  }
+  if (*ok)
+    *ok = writer->close();
+  // The dataset is complete, the checkpoint is of no use any more.
+  if (*ok)
+    std::remove(checkpoint_path().c_str());
+}
 
-    Result &res = results[i];
-    res.attacker = attacker;
-    res.defender = defender;
-    res.attacker_mean = calc_mean(attacker_samples);
-    res.defender_mean = calc_mean(defender_samples);
-    res.attacker_sd = calc_sd(attacker_samples, res.attacker_mean);
-    res.defender_sd = calc_sd(defender_samples, res.defender_mean);
+void dump_worker_stats(const std::vector<WorkerStats> &stats) {
+  std::cout << "Workers:\n";
+  for (std::size_t i = 0; i < stats.size(); ++i) {
+    std::cout << "  " << std::setw(3) << i << ": ";
+    if (opt_affinity != Affinity::None)
+      std::cout << "node " << stats[i].node << ", ";
+    std::cout << "chunks " << stats[i].num_chunks << ", rows " << stats[i].num_rows
+              << ", busy " << std::setprecision(2) << std::fixed << stats[i].busy_seconds << " s, waiting for writer "
+              << stats[i].wait_seconds << " s\n";
+  }
 
-    progress.fetch_add(1, std::memory_order_relaxed);
+  std::uint64_t num_rows = 0;
+  std::uint64_t num_battles = 0;
+  std::uint64_t num_trivial_rows = 0;
+  std::uint64_t num_scenarios = 0;
+  for (const auto &s : stats) {
+    num_rows += s.num_rows;
+    num_battles += s.num_battles;
+    num_trivial_rows += s.num_trivial_rows;
+    num_scenarios += s.num_scenarios;
+  }
+  std::cout << "Battles: " << num_battles;
+  if (num_rows != 0)
+    std::cout << " (" << static_cast<double>(num_battles) / static_cast<double>(num_rows) << " per row)";
+  std::cout << '\n'
+            << "Trivial rows, not fought: " << num_trivial_rows << '\n';
+  if (opt_sampler != SamplerKind::Uniform && num_rows != 0) {
+    std::cout << "Scenarios drawn: " << num_scenarios << " ("
+              << static_cast<double>(num_scenarios) / static_cast<double>(num_rows) << " per row)\n";
+  }
+}
+
+void dump_engine_stats(const std::vector<WorkerStats> &stats) {
+  EngineStats engine{};
+  for (const auto &s : stats)
+    engine.merge(s.engine);
+
+  const auto per_battle = [&](std::uint64_t n) {
+    return engine.battles != 0 ? static_cast<double>(n) / static_cast<double>(engine.battles) : 0.0;
+  };
+  const std::uint64_t shots = std::accumulate(engine.shots.begin(), engine.shots.end(), std::uint64_t{0});
+
+  std::cout << "Engine:\n"
+            << "  battles:          " << engine.battles << '\n'
+            << "  shots:            " << shots << " (" << per_battle(shots) << " per battle)\n"
+            << "  dead target hits: " << engine.dead_target_hits << '\n'
+            << "  shield bounces:   " << engine.shield_bounces << '\n'
+            << "  explosion rolls:  " << engine.explosion_rolls << ", kills " << engine.explosion_kills << '\n'
+            << "  rapid fire shots by shooter kind:\n";
+  for (std::uint32_t kind = 0; kind < UnitKindEnd; ++kind) {
+    if (engine.shooters[kind] != 0) {
+      std::cout << "    " << std::setw(16) << std::left << unit_names[kind] << std::right << ' '
+                << engine.shots[kind] - engine.shooters[kind] << " ("
+                << static_cast<double>(engine.shots[kind]) / static_cast<double>(engine.shooters[kind])
+                << " shots per shooter)\n";
+    }
+  }
+  std::cout << "  battles by rounds:";
+  for (std::uint64_t n : engine.rounds)
+    std::cout << ' ' << n;
+  std::cout << "\n"
+            << "  ticks per battle:\n";
+  for (std::size_t phase = 0; phase < num_battle_phases; ++phase) {
+    std::cout << "    " << std::setw(16) << std::left << battle_phase_names[phase] << std::right << ' '
+              << per_battle(engine.phase_ticks[phase]) << '\n';
   }
 }
 
@@ -190,7 +859,13 @@ int main(int /*argc*/, const char *const *argv) {
   parse_args(argv);
 
   if (opt_num_threads == 0)
-    opt_num_threads = std::thread::hardware_concurrency();
+    opt_num_threads = num_allowed_cpus();
+
+  DatasetCheckpoint checkpoint{};
+  if (opt_resume) {
+    checkpoint = load_checkpoint_or_die();
+    resumed_rows = static_cast<std::uint32_t>(checkpoint.num_rows);
+  }
 
   if (opt_seed == 0) {
     opt_seed = std::random_device{}();
@@ -198,29 +873,43 @@ int main(int /*argc*/, const char *const *argv) {
     if (opt_seed == 0)
       opt_seed = 1;
   }
-  auto rng = std::mt19937{opt_seed};
 
-  std::ofstream out_file{opt_out};
-  if (!out_file.is_open()) {
+  const auto sampler = make_scenario_sampler();
+
+  const std::uint32_t extra_columns = (adaptive_smoothing() ? num_replicas_column : 0) |
+                                      (opt_sampler == SamplerKind::Weighted ? weight_column : 0);
+  auto writer = make_dataset_writer(opt_format, extra_columns, opt_csv_precision);
+  const DatasetRange range{.seed = opt_seed,
+                           .first_row = opt_row_begin,
+                           .num_rows = num_rows(),
+                           .dataset_size = opt_dataset_size,
+                           .options = generation_options()};
+  if (!(opt_resume ? writer->reopen(opt_out, range, checkpoint) : writer->open(opt_out, range))) {
     std::cerr << "Failed to open '" << opt_out << "'\n";
     return 1;
   }
+  // Replaces any checkpoint left by an earlier run with the same --out, which no longer matches the file.
+  if (opt_checkpoint_interval == 0.0) {
+    std::remove(checkpoint_path().c_str());
+  } else if (!writer->sync(checkpoint) || !save_checkpoint(checkpoint)) {
+    std::cerr << "Failed to write the checkpoint '" << checkpoint_path() << "'\n";
+    return 1;
+  }
 
   dump_settings();
 
   std::vector<std::thread> threads;
   threads.reserve(opt_num_threads);
 
-  std::vector<Result> results(opt_dataset_size);
-  auto res_ptr = results.data();
+  ChunkQueue queue{static_cast<std::size_t>(opt_queue_depth) * opt_num_threads};
+  std::vector<WorkerStats> worker_stats(opt_num_threads);
+  const ThreadPlacement placement{opt_affinity, opt_num_threads};
 
-  for (std::uint32_t i = 0; i < opt_num_threads; ++i) {
-    std::uint32_t size = opt_dataset_size / opt_num_threads;
-    if (i == 0)
-      size += opt_dataset_size % opt_num_threads;
-    threads.push_back(std::thread{worker, res_ptr, size, rng()});
-    res_ptr += size;
-  }
+  bool write_ok = false;
+  std::thread writer_thread{write_chunks, writer.get(), &queue, &write_ok};
+
+  for (std::uint32_t i = 0; i < opt_num_threads; ++i)
+    threads.push_back(std::thread{worker, &placement, i, sampler.get(), writer.get(), &queue, &worker_stats[i]});
 
   for (;;) {
     std::uint32_t p = progress.load(std::memory_order_relaxed);
@@ -228,11 +917,13 @@ int main(int /*argc*/, const char *const *argv) {
     std::cout << '\r';
     for (std::uint32_t i = 0; i < 80; ++i)
       std::cout << ' ';
-    std::cout << "\rProgress: " << p << '/' << opt_dataset_size << " " << std::setprecision(2) << std::fixed
-              << 100.0 * static_cast<double>(p) / static_cast<double>(opt_dataset_size) << '%';
+    const std::uint32_t done = resumed_rows + p;
+    std::cout << "\rProgress: " << done << '/' << num_rows() << " " << std::setprecision(2) << std::fixed
+              << (num_rows() != 0 ? 100.0 * static_cast<double>(done) / static_cast<double>(num_rows()) : 100.0)
+              << '%';
     std::cout.flush();
 
-    if (p == opt_dataset_size) {
+    if (p == num_rows_to_generate()) {
       std::cout << '\n';
       break;
     }
@@ -242,39 +933,16 @@ int main(int /*argc*/, const char *const *argv) {
 
   for (auto &thread : threads)
     thread.join();
+  writer_thread.join();
 
-  // Write the results to the dataset file.
+  dump_worker_stats(worker_stats);
+  if (opt_stats)
+    dump_engine_stats(worker_stats);
 
-  auto dump_techs = [&](const CombatTechs &techs) {
-    out_file << static_cast<std::uint32_t>(techs.weapons) << ',' << static_cast<std::uint32_t>(techs.shielding) << ','
-             << static_cast<std::uint32_t>(techs.armor);
-  };
-  auto dump_units = [&](const auto &units) {
-    for (std::uint8_t kind = 0; kind <= Battlecruiser; ++kind) {
-      out_file << static_cast<double>(units[kind]);
-      if (kind != Battlecruiser)
-        out_file << ',';
-    }
-  };
-  for (const auto &result : results) {
-    dump_techs(result.attacker.techs);
-    out_file << ',';
-    dump_techs(result.defender.techs);
-    out_file << ',';
-    dump_units(result.attacker.unit_groups);
-    out_file << ',';
-    dump_units(result.defender.unit_groups);
-    out_file << ',';
-    dump_units(result.attacker_mean);
-    out_file << ',';
-    dump_units(result.defender_mean);
-    out_file << ',';
-    dump_units(result.attacker_sd);
-    out_file << ',';
-    dump_units(result.defender_sd);
-    out_file << '\n';
-  }
-  out_file.close();
+  if (!write_ok) {
+    std::cerr << "Failed to write '" << opt_out << "'\n";
+    return 1;
+  }
 
   return 0;
 }
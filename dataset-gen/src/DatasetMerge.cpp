@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "DatasetWriter.hpp"
+#include "FileIo.hpp"
+
+using namespace dataset_gen;
+
+namespace {
+
+// Options
+
+const char *opt_out = nullptr;
+std::vector<const char *> opt_inputs{};
+
+void parse_args(const char *const *argv) {
+  const char *arg0 = *argv++;
+  for (; *argv != nullptr; ++argv) {
+    if (std::strcmp(*argv, "-h") == 0 || std::strcmp(*argv, "--help") == 0) {
+      std::cout << "Usage: " << arg0 << " --out path input...\n"
+                << '\n'
+                << "Joins the parts of a dataset generated with dataset-gen --shard or --row-range. Binary parts\n"
+                << "must come from the same dataset (seed, size, options and columns) and cover consecutive rows;\n"
+                << "they are joined in the order of their rows. CSV parts have no such metadata and are\n"
+                << "concatenated in the given order.\n"
+                << '\n'
+                << "Options:\n"
+                << "  --out path        Output path of the joined dataset\n";
+      std::exit(0);
+    } else if (std::strcmp(*argv, "--out") == 0) {
+      opt_out = *++argv;
+      if (opt_out == nullptr) {
+        std::cerr << "Failed to parse argument --out\n";
+        std::exit(1);
+      }
+    } else if (**argv == '-' && (*argv)[1] != '\0') {
+      std::cerr << "Unknown argument " << *argv << '\n';
+      std::exit(1);
+    } else {
+      opt_inputs.push_back(*argv);
+    }
+  }
+
+  if (opt_out == nullptr || opt_inputs.empty()) {
+    std::cerr << "Missing --out or inputs\n";
+    std::exit(1);
+  }
+}
+
+bool is_binary(const char *path) {
+  char magic[sizeof(binary_magic)]{};
+  std::ifstream in{path, std::ios::binary};
+  in.read(magic, sizeof(magic));
+  return in && std::memcmp(magic, binary_magic, sizeof(magic)) == 0;
+}
+
+int merge_csv() {
+  std::ofstream out{opt_out, std::ios::binary};
+  if (!out) {
+    std::cerr << "Failed to open '" << opt_out << "'\n";
+    return 1;
+  }
+  for (const char *path : opt_inputs) {
+    std::ifstream in{path, std::ios::binary};
+    if (!in) {
+      std::cerr << "Failed to open '" << path << "'\n";
+      return 1;
+    }
+    // An empty part would make operator<< fail without writing anything.
+    if (in.peek() != std::ifstream::traits_type::eof())
+      out << in.rdbuf();
+  }
+  out.close();
+  if (!out) {
+    std::cerr << "Failed to write '" << opt_out << "'\n";
+    return 1;
+  }
+  std::cout << "Concatenated " << opt_inputs.size() << " CSV files\n";
+  return 0;
+}
+
+struct BinaryPart {
+  const char *path;
+  int fd;
+  BinaryFileHeader header;
+  std::vector<BinaryColumnDesc> columns;
+  std::vector<BinaryUnitKindName> unit_kinds;
+  std::string options;
+};
+
+bool read_part(const char *path, BinaryPart &part) {
+  part.path = path;
+  part.fd = ::open(path, O_RDONLY);
+  if (part.fd == -1 || !pread_all(part.fd, &part.header, sizeof(part.header), 0)) {
+    std::cerr << "Failed to read '" << path << "'\n";
+    return false;
+  }
+  if (part.header.version != binary_version) {
+    std::cerr << "'" << path << "' is a version " << part.header.version << " dataset, version " << binary_version
+              << " is needed\n";
+    return false;
+  }
+  part.columns.resize(part.header.num_columns);
+  part.unit_kinds.resize(part.header.num_unit_kinds);
+  part.options.resize(part.header.options_size);
+  const std::uint64_t columns_offset = sizeof(BinaryFileHeader);
+  const std::uint64_t kinds_offset = columns_offset + part.columns.size() * sizeof(BinaryColumnDesc);
+  const std::uint64_t options_offset = kinds_offset + part.unit_kinds.size() * sizeof(BinaryUnitKindName);
+  if (!pread_all(part.fd, part.columns.data(), part.columns.size() * sizeof(BinaryColumnDesc), columns_offset) ||
+      !pread_all(part.fd, part.unit_kinds.data(), part.unit_kinds.size() * sizeof(BinaryUnitKindName), kinds_offset) ||
+      !pread_all(part.fd, part.options.data(), part.options.size(), options_offset)) {
+    std::cerr << "Failed to read '" << path << "'\n";
+    return false;
+  }
+  return true;
+}
+
+// Whether b is a part of the same dataset as a.
+bool same_dataset(const BinaryPart &a, const BinaryPart &b) {
+  if (a.header.seed != b.header.seed || a.header.dataset_size != b.header.dataset_size || a.options != b.options ||
+      a.columns.size() != b.columns.size() || a.unit_kinds.size() != b.unit_kinds.size())
+    return false;
+  for (std::size_t i = 0; i < a.columns.size(); ++i) {
+    if (std::strncmp(a.columns[i].name, b.columns[i].name, sizeof(a.columns[i].name)) != 0 ||
+        a.columns[i].type != b.columns[i].type || a.columns[i].elem_size != b.columns[i].elem_size)
+      return false;
+  }
+  for (std::size_t i = 0; i < a.unit_kinds.size(); ++i) {
+    if (std::strncmp(a.unit_kinds[i].name, b.unit_kinds[i].name, sizeof(a.unit_kinds[i].name)) != 0)
+      return false;
+  }
+  return true;
+}
+
+int merge_binary() {
+  std::vector<BinaryPart> parts(opt_inputs.size());
+  for (std::size_t i = 0; i < parts.size(); ++i) {
+    if (!read_part(opt_inputs[i], parts[i]))
+      return 1;
+    if (!same_dataset(parts[0], parts[i])) {
+      std::cerr << "'" << parts[i].path << "' is not a part of the same dataset as '" << parts[0].path << "'\n";
+      return 1;
+    }
+  }
+
+  std::ranges::sort(parts, {}, [](const BinaryPart &part) { return part.header.first_row; });
+  for (std::size_t i = 1; i < parts.size(); ++i) {
+    const BinaryFileHeader &prev = parts[i - 1].header;
+    if (prev.first_row + prev.num_rows != parts[i].header.first_row) {
+      std::cerr << "'" << parts[i - 1].path << "' ends at row " << prev.first_row + prev.num_rows << " but '"
+                << parts[i].path << "' starts at row " << parts[i].header.first_row << '\n';
+      return 1;
+    }
+  }
+
+  BinaryFileHeader header = parts[0].header;
+  header.num_rows = parts.back().header.first_row + parts.back().header.num_rows - header.first_row;
+  std::vector<BinaryColumnDesc> columns = parts[0].columns;
+  const std::uint64_t file_size = layout_binary_file(header, columns);
+
+  const int fd = ::open(opt_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    std::cerr << "Failed to open '" << opt_out << "'\n";
+    return 1;
+  }
+
+  bool ok = pwrite_all(fd, &header, sizeof(header), 0) &&
+            pwrite_all(fd, columns.data(), columns.size() * sizeof(BinaryColumnDesc), sizeof(header)) &&
+            pwrite_all(fd, parts[0].unit_kinds.data(), parts[0].unit_kinds.size() * sizeof(BinaryUnitKindName),
+                       sizeof(header) + columns.size() * sizeof(BinaryColumnDesc)) &&
+            pwrite_all(fd, parts[0].options.data(), parts[0].options.size(),
+                       sizeof(header) + columns.size() * sizeof(BinaryColumnDesc) +
+                           parts[0].unit_kinds.size() * sizeof(BinaryUnitKindName)) &&
+            ::ftruncate(fd, static_cast<off_t>(file_size)) == 0;
+
+  // Copies every column block of every part to its place in the joined block.
+  std::vector<char> buffer(std::size_t{1} << 22);
+  for (std::size_t j = 0; ok && j < columns.size(); ++j) {
+    std::uint64_t out_offset = columns[j].offset;
+    for (const BinaryPart &part : parts) {
+      std::uint64_t in_offset = part.columns[j].offset;
+      std::uint64_t size = part.header.num_rows * columns[j].elem_size;
+      while (ok && size > 0) {
+        const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(size, buffer.size()));
+        ok = pread_all(part.fd, buffer.data(), n, in_offset) && pwrite_all(fd, buffer.data(), n, out_offset);
+        in_offset += n;
+        out_offset += n;
+        size -= n;
+      }
+    }
+  }
+  ok = ::close(fd) == 0 && ok;
+  for (const BinaryPart &part : parts)
+    ::close(part.fd);
+
+  if (!ok) {
+    std::cerr << "Failed to write '" << opt_out << "'\n";
+    return 1;
+  }
+
+  std::cout << "Joined " << parts.size() << " parts: rows " << header.first_row << ':'
+            << header.first_row + header.num_rows << " of " << header.dataset_size << '\n';
+  return 0;
+}
+
+} // namespace
+
+int main(int /*argc*/, const char *const *argv) {
+  parse_args(argv);
+
+  const bool binary = is_binary(opt_inputs[0]);
+  for (const char *path : opt_inputs) {
+    if (is_binary(path) != binary) {
+      std::cerr << "Cannot join binary and CSV datasets\n";
+      return 1;
+    }
+  }
+
+  return binary ? merge_binary() : merge_csv();
+}
@@ -0,0 +1,340 @@
+#include "DatasetWriter.hpp"
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FileIo.hpp"
+
+namespace dataset_gen {
+
+std::vector<Column> dataset_columns(std::uint32_t extra_columns) {
+  std::vector<Column> columns;
+
+  const char *const sides[] = {"attacker", "defender"};
+  for (const char *side : sides) {
+    for (const char *tech : {"weapons", "shielding", "armor"})
+      columns.push_back({std::string{side} + '_' + tech, ColumnType::UInt8});
+  }
+  for (const char *side : sides) {
+    for (std::uint32_t kind = 0; kind < num_dataset_kinds; ++kind)
+      columns.push_back({std::string{side} + '_' + unit_names[kind], ColumnType::Float32});
+  }
+  for (const char *stat : {"mean", "sd"}) {
+    for (const char *side : sides) {
+      for (std::uint32_t kind = 0; kind < num_dataset_kinds; ++kind)
+        columns.push_back({std::string{side} + '_' + stat + '_' + unit_names[kind], ColumnType::Float32});
+    }
+  }
+  if ((extra_columns & num_replicas_column) != 0)
+    columns.push_back({"num_replicas", ColumnType::UInt32});
+  if ((extra_columns & weight_column) != 0)
+    columns.push_back({"weight", ColumnType::Float32});
+
+  return columns;
+}
+
+void flatten_result(const Result &result, std::uint32_t extra_columns, double *row) {
+  auto put_techs = [&](const CombatTechs &techs) {
+    *row++ = techs.weapons;
+    *row++ = techs.shielding;
+    *row++ = techs.armor;
+  };
+  auto put_units = [&](const auto &units) {
+    for (std::uint32_t kind = 0; kind < num_dataset_kinds; ++kind)
+      *row++ = static_cast<double>(units[kind]);
+  };
+
+  put_techs(result.attacker.techs);
+  put_techs(result.defender.techs);
+  put_units(result.attacker.unit_groups);
+  put_units(result.defender.unit_groups);
+  put_units(result.attacker_mean);
+  put_units(result.defender_mean);
+  put_units(result.attacker_sd);
+  put_units(result.defender_sd);
+  if ((extra_columns & num_replicas_column) != 0)
+    *row++ = result.num_replicas;
+  if ((extra_columns & weight_column) != 0)
+    *row++ = result.weight;
+}
+
+namespace {
+
+std::uint64_t align_up(std::uint64_t value, std::uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+std::uint64_t layout_binary_file(BinaryFileHeader &header, std::span<BinaryColumnDesc> descs) {
+  const std::uint64_t header_size = align_up(sizeof(BinaryFileHeader) + descs.size() * sizeof(BinaryColumnDesc) +
+                                                 header.num_unit_kinds * sizeof(BinaryUnitKindName) +
+                                                 header.options_size,
+                                             binary_alignment);
+  header.header_size = static_cast<std::uint32_t>(header_size);
+
+  std::uint64_t offset = header_size;
+  for (BinaryColumnDesc &desc : descs) {
+    desc.offset = offset;
+    offset = align_up(offset + header.num_rows * desc.elem_size, binary_alignment);
+  }
+  return offset;
+}
+
+namespace {
+
+std::uint32_t column_elem_size(ColumnType type) {
+  switch (type) {
+  case ColumnType::UInt8:
+    return 1;
+  case ColumnType::Float32:
+  case ColumnType::UInt32:
+    return 4;
+  }
+  return 0;
+}
+
+// Longest value with up to 17 significant digits, such as -2.2250738585072014e-308, and its separator.
+constexpr std::size_t max_csv_value_size = 25;
+// Encoded rows are collected and written in blocks of at least this size.
+constexpr std::size_t csv_write_size = std::size_t{1} << 22;
+
+class CsvWriter final : public DatasetWriter {
+public:
+  CsvWriter(std::uint32_t extra_columns, std::uint32_t precision)
+      : extra_columns_{extra_columns}, precision_{static_cast<int>(precision)},
+        num_columns_{dataset_columns(extra_columns).size()} {}
+
+  ~CsvWriter() override {
+    if (fd_ != -1)
+      ::close(fd_);
+  }
+
+  bool open(const char *path, const DatasetRange & /*range*/) override {
+    fd_ = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    return fd_ != -1;
+  }
+
+  bool reopen(const char *path, const DatasetRange & /*range*/, const DatasetCheckpoint &checkpoint) override {
+    num_rows_ = checkpoint.num_rows;
+    size_ = checkpoint.size;
+    fd_ = ::open(path, O_WRONLY);
+    struct stat st {};
+    return fd_ != -1 && ::fstat(fd_, &st) == 0 && static_cast<std::uint64_t>(st.st_size) >= size_ &&
+           ::ftruncate(fd_, static_cast<off_t>(size_)) == 0;
+  }
+
+  void encode(const Result *results, std::size_t num_results, std::vector<char> &encoded) const override {
+    std::vector<double> row(num_columns_);
+    encoded.resize(num_results * num_columns_ * max_csv_value_size);
+    char *ptr = encoded.data();
+    char *const end = ptr + encoded.size();
+    for (std::size_t i = 0; i < num_results; ++i) {
+      flatten_result(results[i], extra_columns_, row.data());
+      for (std::size_t j = 0; j < num_columns_; ++j) {
+        ptr = precision_ == 0 ? std::to_chars(ptr, end, row[j]).ptr
+                              : std::to_chars(ptr, end, row[j], std::chars_format::general, precision_).ptr;
+        *ptr++ = j + 1 != num_columns_ ? ',' : '\n';
+      }
+    }
+    encoded.resize(static_cast<std::size_t>(ptr - encoded.data()));
+  }
+
+  bool write(const Result *results, std::size_t num_results, std::span<const char> encoded) override {
+    if (encoded.empty()) {
+      encode(results, num_results, encoded_);
+      encoded = encoded_;
+    }
+    buffer_.insert(buffer_.end(), encoded.begin(), encoded.end());
+    num_rows_ += num_results;
+    return buffer_.size() < csv_write_size || flush();
+  }
+
+  bool sync(DatasetCheckpoint &checkpoint) override {
+    const bool ok = flush();
+    checkpoint = {.num_rows = num_rows_, .size = size_};
+    return ok && ::fdatasync(fd_) == 0;
+  }
+
+  bool close() override {
+    const bool ok = flush();
+    int fd = fd_;
+    fd_ = -1;
+    return ::close(fd) == 0 && ok;
+  }
+
+private:
+  bool flush() {
+    const bool ok = pwrite_all(fd_, buffer_.data(), buffer_.size(), size_);
+    size_ += buffer_.size();
+    buffer_.clear();
+    return ok;
+  }
+
+  std::uint32_t extra_columns_;
+  int precision_;
+  std::size_t num_columns_;
+  int fd_ = -1;
+  std::uint64_t num_rows_ = 0;
+  // Bytes written to the file, not counting buffer_.
+  std::uint64_t size_ = 0;
+  std::vector<char> buffer_{};
+  std::vector<char> encoded_{};
+};
+
+class BinaryWriter final : public DatasetWriter {
+public:
+  explicit BinaryWriter(std::uint32_t extra_columns)
+      : extra_columns_{extra_columns}, columns_{dataset_columns(extra_columns)} {}
+
+  ~BinaryWriter() override {
+    if (fd_ != -1)
+      ::close(fd_);
+  }
+
+  bool open(const char *path, const DatasetRange &range) override { return create(path, range, O_CREAT | O_TRUNC); }
+
+  // The header and the size of the file only depend on the range, so they are written again as they are.
+  bool reopen(const char *path, const DatasetRange &range, const DatasetCheckpoint &checkpoint) override {
+    if (checkpoint.num_rows > range.num_rows || !create(path, range, 0))
+      return false;
+    next_row_ = checkpoint.num_rows;
+    return true;
+  }
+
+  bool write(const Result *results, std::size_t num_results, std::span<const char> /*encoded*/) override {
+    if (next_row_ + num_results > num_rows_)
+      return false;
+
+    const std::size_t num_columns = columns_.size();
+    rows_.resize(num_results * num_columns);
+    for (std::size_t i = 0; i < num_results; ++i)
+      flatten_result(results[i], extra_columns_, &rows_[i * num_columns]);
+
+    for (std::size_t j = 0; j < num_columns; ++j) {
+      const std::uint32_t elem_size = column_elem_size(columns_[j].type);
+      block_.resize(num_results * elem_size);
+      for (std::size_t i = 0; i < num_results; ++i) {
+        const double value = rows_[i * num_columns + j];
+        switch (columns_[j].type) {
+        case ColumnType::UInt8:
+          block_[i] = static_cast<std::uint8_t>(value);
+          break;
+        case ColumnType::Float32: {
+          const float f = static_cast<float>(value);
+          std::memcpy(&block_[i * sizeof(f)], &f, sizeof(f));
+          break;
+        }
+        case ColumnType::UInt32: {
+          const auto u = static_cast<std::uint32_t>(value);
+          std::memcpy(&block_[i * sizeof(u)], &u, sizeof(u));
+          break;
+        }
+        }
+      }
+      if (!pwrite_all(fd_, block_.data(), block_.size(), offsets_[j] + next_row_ * elem_size))
+        return false;
+    }
+
+    next_row_ += num_results;
+    return true;
+  }
+
+  bool sync(DatasetCheckpoint &checkpoint) override {
+    checkpoint = {.num_rows = next_row_, .size = 0};
+    return ::fdatasync(fd_) == 0;
+  }
+
+  bool close() override {
+    int fd = fd_;
+    fd_ = -1;
+    return next_row_ == num_rows_ && ::close(fd) == 0;
+  }
+
+private:
+  // Opens path with the extra open flags and writes the header of the range.
+  bool create(const char *path, const DatasetRange &range, int flags) {
+    fd_ = ::open(path, O_WRONLY | flags, 0644);
+    if (fd_ == -1)
+      return false;
+
+    num_rows_ = range.num_rows;
+
+    BinaryFileHeader header{};
+    std::memcpy(header.magic, binary_magic, sizeof(header.magic));
+    header.version = binary_version;
+    header.num_rows = range.num_rows;
+    header.num_columns = static_cast<std::uint32_t>(columns_.size());
+    header.num_unit_kinds = num_dataset_kinds;
+    header.alignment = binary_alignment;
+    header.seed = range.seed;
+    header.first_row = range.first_row;
+    header.dataset_size = range.dataset_size;
+    header.options_size = static_cast<std::uint32_t>(range.options.size());
+
+    std::vector<BinaryColumnDesc> descs(columns_.size());
+    for (std::size_t i = 0; i < columns_.size(); ++i) {
+      BinaryColumnDesc &desc = descs[i];
+      std::strncpy(desc.name, columns_[i].name.c_str(), sizeof(desc.name) - 1);
+      desc.type = static_cast<std::uint32_t>(columns_[i].type);
+      desc.elem_size = column_elem_size(columns_[i].type);
+    }
+    const std::uint64_t file_size = layout_binary_file(header, descs);
+    for (const BinaryColumnDesc &desc : descs)
+      offsets_.push_back(desc.offset);
+
+    std::vector<BinaryUnitKindName> kind_names(num_dataset_kinds);
+    for (std::uint32_t kind = 0; kind < num_dataset_kinds; ++kind)
+      std::strncpy(kind_names[kind].name, unit_names[kind], sizeof(kind_names[kind].name) - 1);
+
+    std::uint64_t pos = 0;
+    if (!pwrite_all(fd_, &header, sizeof(header), pos))
+      return false;
+    pos += sizeof(header);
+    if (!pwrite_all(fd_, descs.data(), descs.size() * sizeof(BinaryColumnDesc), pos))
+      return false;
+    pos += descs.size() * sizeof(BinaryColumnDesc);
+    if (!pwrite_all(fd_, kind_names.data(), kind_names.size() * sizeof(BinaryUnitKindName), pos))
+      return false;
+    pos += kind_names.size() * sizeof(BinaryUnitKindName);
+    if (!pwrite_all(fd_, range.options.data(), range.options.size(), pos))
+      return false;
+
+    // Reserve the whole file, so that blocks of the columns not written yet read as zeros.
+    return ::ftruncate(fd_, static_cast<off_t>(file_size)) == 0;
+  }
+
+  int fd_ = -1;
+  std::uint64_t num_rows_ = 0;
+  std::uint64_t next_row_ = 0;
+  std::uint32_t extra_columns_;
+  std::vector<Column> columns_;
+  std::vector<std::uint64_t> offsets_{};
+  std::vector<double> rows_{};
+  std::vector<std::uint8_t> block_{};
+};
+
+} // namespace
+
+std::unique_ptr<DatasetWriter> make_dataset_writer(DatasetFormat format, std::uint32_t extra_columns,
+                                                   std::uint32_t csv_precision) {
+  switch (format) {
+  case DatasetFormat::Csv:
+    return std::make_unique<CsvWriter>(extra_columns, csv_precision);
+  case DatasetFormat::Binary:
+    return std::make_unique<BinaryWriter>(extra_columns);
+  }
+  return nullptr;
+}
+
+} // namespace dataset_gen
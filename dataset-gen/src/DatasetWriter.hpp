@@ -0,0 +1,165 @@
+#ifndef DATASET_GEN_DATASET_WRITER_HPP
+#define DATASET_GEN_DATASET_WRITER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "BattleEngine.hpp"
+#include "UnitGroups.hpp"
+#include "Units.hpp"
+
+namespace dataset_gen {
+
+// Only ships take part in the generated battles.
+constexpr std::uint32_t num_dataset_kinds = num_ship_kinds;
+
+struct Result {
+  Combatant attacker;
+  Combatant defender;
+  UnitGroups<double> attacker_mean;
+  UnitGroups<double> defender_mean;
+  UnitGroups<double> attacker_sd;
+  UnitGroups<double> defender_sd;
+  std::uint32_t num_replicas;
+  // Importance weight of the row, with a weighted sampler.
+  double weight;
+};
+
+// Columns
+
+enum class ColumnType : std::uint32_t {
+  UInt8 = 1,
+  Float32 = 2,
+  UInt32 = 3,
+};
+
+struct Column {
+  std::string name;
+  ColumnType type;
+};
+
+// Optional columns, appended after the standard ones in the order of these flags.
+constexpr std::uint32_t num_replicas_column = 1u << 0;
+constexpr std::uint32_t weight_column = 1u << 1;
+
+// Returns the dataset columns in the order they are written (the same order for all formats).
+std::vector<Column> dataset_columns(std::uint32_t extra_columns);
+
+// Writes all column values of the result into row, in the order of dataset_columns().
+void flatten_result(const Result &result, std::uint32_t extra_columns, double *row);
+
+// Binary format
+//
+// The file starts with a BinaryFileHeader, followed by num_columns BinaryColumnDescs, num_unit_kinds
+// BinaryUnitKindNames and options_size bytes of options. Each column is stored as a contiguous block of num_rows
+// values, starting at the offset given in its descriptor. Offsets are aligned to binary_alignment, so every block can
+// be memory mapped directly.
+//
+// Version 2 records where the rows come from: they are rows [first_row, first_row + num_rows) of a dataset of
+// dataset_size rows generated with seed, so that dataset-merge can check and join the shards of a dataset. Version 1
+// files have zeros there. Version 3 adds the options: the other options of dataset-gen that change the rows, as
+// "name value" lines, which dataset-merge compares as well.
+
+constexpr char binary_magic[8] = {'O', 'G', 'N', 'N', 'D', 'S', 'E', 'T'};
+constexpr std::uint32_t binary_version = 3;
+constexpr std::uint32_t binary_alignment = 64;
+
+struct BinaryFileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t header_size;
+  std::uint64_t num_rows;
+  std::uint32_t num_columns;
+  std::uint32_t num_unit_kinds;
+  std::uint32_t alignment;
+  std::uint32_t seed;
+  std::uint64_t first_row;
+  std::uint64_t dataset_size;
+  std::uint32_t options_size;
+  std::uint32_t reserved;
+};
+
+struct BinaryColumnDesc {
+  char name[40];
+  std::uint32_t type;
+  std::uint32_t elem_size;
+  std::uint64_t offset;
+  std::uint64_t reserved;
+};
+
+struct BinaryUnitKindName {
+  char name[32];
+};
+
+static_assert(sizeof(BinaryFileHeader) == 64);
+static_assert(sizeof(BinaryColumnDesc) == 64);
+static_assert(sizeof(BinaryUnitKindName) == 32);
+
+// Sets header.header_size and the offsets of the column blocks of descs (their elem_size set) for header.num_rows rows,
+// header.num_unit_kinds unit kinds and header.options_size bytes of options. Returns the size of the file.
+std::uint64_t layout_binary_file(BinaryFileHeader &header, std::span<BinaryColumnDesc> descs);
+
+// Writers
+
+enum class DatasetFormat {
+  Csv,
+  Binary,
+};
+
+// The rows written to a file: rows [first_row, first_row + num_rows) of a dataset of dataset_size rows, generated with
+// seed and the other options, "name value" lines recorded by the binary format.
+struct DatasetRange {
+  std::uint32_t seed;
+  std::uint64_t first_row;
+  std::uint64_t num_rows;
+  std::uint64_t dataset_size;
+  std::string options;
+};
+
+// How far a file has been written: its first num_rows rows, in its first size bytes (CSV only).
+struct DatasetCheckpoint {
+  std::uint64_t num_rows;
+  std::uint64_t size;
+};
+
+class DatasetWriter {
+public:
+  virtual ~DatasetWriter() = default;
+
+  // Creates the output file for the rows of range.
+  virtual bool open(const char *path, const DatasetRange &range) = 0;
+
+  // Opens a file left by an interrupted run with the same range, to go on after the rows of checkpoint. Whatever was
+  // written after them is overwritten.
+  virtual bool reopen(const char *path, const DatasetRange &range, const DatasetCheckpoint &checkpoint) = 0;
+
+  // Encodes rows for write() ahead of time, so that the threads producing them can share the work. Thread-safe.
+  // Writers with nothing to encode ahead leave encoded empty.
+  virtual void encode(const Result * /*results*/, std::size_t /*num_results*/, std::vector<char> &encoded) const {
+    encoded.clear();
+  }
+
+  // Appends the next num_results rows. encoded is what encode() made of them, or empty to encode them here.
+  virtual bool write(const Result *results, std::size_t num_results, std::span<const char> encoded) = 0;
+
+  // Flushes the rows written so far to the disk and returns how far the file is written.
+  virtual bool sync(DatasetCheckpoint &checkpoint) = 0;
+
+  virtual bool close() = 0;
+};
+
+// CSV values are written with csv_precision significant digits, as printf("%.<csv_precision>g"), or with the fewest
+// digits that read back as the same double if it is 0. The default 6 is what operator<< writes.
+constexpr std::uint32_t default_csv_precision = 6;
+constexpr std::uint32_t max_csv_precision = 17;
+
+std::unique_ptr<DatasetWriter> make_dataset_writer(DatasetFormat format, std::uint32_t extra_columns,
+                                                   std::uint32_t csv_precision = default_csv_precision);
+
+} // namespace dataset_gen
+
+#endif // !DATASET_GEN_DATASET_WRITER_HPP
@@ -0,0 +1,41 @@
+#ifndef DATASET_GEN_FILE_IO_HPP
+#define DATASET_GEN_FILE_IO_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <unistd.h>
+
+namespace dataset_gen {
+
+// pread() and pwrite() of all size bytes at offset, retrying short transfers. False on errors and end of file.
+
+inline bool pread_all(int fd, void *data, std::size_t size, std::uint64_t offset) {
+  char *ptr = static_cast<char *>(data);
+  while (size > 0) {
+    ssize_t n = ::pread(fd, ptr, size, static_cast<off_t>(offset));
+    if (n <= 0)
+      return false;
+    ptr += n;
+    size -= static_cast<std::size_t>(n);
+    offset += static_cast<std::uint64_t>(n);
+  }
+  return true;
+}
+
+inline bool pwrite_all(int fd, const void *data, std::size_t size, std::uint64_t offset) {
+  const char *ptr = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t n = ::pwrite(fd, ptr, size, static_cast<off_t>(offset));
+    if (n <= 0)
+      return false;
+    ptr += n;
+    size -= static_cast<std::size_t>(n);
+    offset += static_cast<std::uint64_t>(n);
+  }
+  return true;
+}
+
+} // namespace dataset_gen
+
+#endif // !DATASET_GEN_FILE_IO_HPP
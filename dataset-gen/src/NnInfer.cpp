@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Args.hpp"
+#include "NnInferApi.h"
+#include "NnModel.hpp"
+#include "Topology.hpp"
+
+using namespace dataset_gen;
+
+namespace {
+
+constexpr std::uint32_t num_techs = 3;
+
+// Options
+
+const char *opt_model = nullptr;
+NnPrecision opt_precision = NnPrecision::Float32;
+std::uint32_t opt_num_threads = 0;
+std::uint32_t opt_batch_size = 4096;
+bool opt_bench = false;
+double opt_min_time = 1.0;
+
+void parse_args(const char *const *argv) {
+  const char *arg0 = *argv++;
+  for (; *argv != nullptr; ++argv) {
+    if (std::strcmp(*argv, "-h") == 0 || std::strcmp(*argv, "--help") == 0) {
+      std::cout << "Usage: " << arg0 << " --model path [OPTIONS]\n"
+                << '\n'
+                << "Predicts the battles read from stdin with a model exported by export-model.py. Every line holds\n"
+                << "the inputs of a dataset row, comma separated: weapons, shielding and armor of the attacker and\n"
+                << "the defender, then their units. Further columns and lines not starting with a number (the CSV\n"
+                << "header) are ignored. Prints the predicted means and standard deviations, in the column order of\n"
+                << "the dataset.\n"
+                << '\n'
+                << "Options:\n"
+                << "  --batch-size n    Number of battles predicted at once (default: 4096)\n"
+                << "  --bench           Time single battles and batches of random battles instead, print JSON\n"
+                << "  --int8            Quantize the weights and the activations to int8\n"
+                << "  --min-time x      Min number of seconds of each --bench measurement (default: 1)\n"
+                << "  --model path      Model file written by export-model.py\n"
+                << "  --num-threads n   Number of threads (default: 0, one per available CPU)\n";
+      std::exit(0);
+    } else if (std::strcmp(*argv, "--batch-size") == 0) {
+      opt_batch_size = parse_int_arg_or_die<std::uint32_t>(*++argv, "--batch-size");
+      if (opt_batch_size == 0) {
+        std::cerr << "--batch-size must be at least 1\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--bench") == 0) {
+      opt_bench = true;
+    } else if (std::strcmp(*argv, "--int8") == 0) {
+      opt_precision = NnPrecision::Int8;
+    } else if (std::strcmp(*argv, "--min-time") == 0) {
+      const char *arg = *++argv;
+      char *end = nullptr;
+      opt_min_time = arg != nullptr ? std::strtod(arg, &end) : -1.0;
+      if (end == arg || *end != '\0' || opt_min_time < 0.0) {
+        std::cerr << "Failed to parse argument --min-time\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--model") == 0) {
+      opt_model = *++argv;
+      if (opt_model == nullptr) {
+        std::cerr << "Failed to parse argument --model\n";
+        std::exit(1);
+      }
+    } else if (std::strcmp(*argv, "--num-threads") == 0) {
+      opt_num_threads = parse_int_arg_or_die<std::uint32_t>(*++argv, "--num-threads");
+    } else {
+      std::cerr << "Unknown argument " << *argv << '\n';
+      std::exit(1);
+    }
+  }
+
+  if (opt_model == nullptr) {
+    std::cerr << "Missing --model\n";
+    std::exit(1);
+  }
+}
+
+// Batches of battles in the layout of the C API.
+struct Batch {
+  std::vector<std::uint8_t> techs{};
+  std::vector<std::uint32_t> units{};
+  std::vector<float> means{};
+  std::vector<float> sds{};
+
+  std::size_t size() const { return techs.size() / (2 * num_techs); }
+
+  void predict(NnInfer *nn) {
+    means.resize(units.size());
+    sds.resize(units.size());
+    nn_infer_predict(nn, size(), techs.data(), units.data(), means.data(), sds.data());
+  }
+
+  void clear() {
+    techs.clear();
+    units.clear();
+  }
+};
+
+void print_predictions(const Batch &batch, std::uint32_t num_battle_units) {
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    for (std::uint32_t j = 0; j < num_battle_units; ++j)
+      std::cout << batch.means[i * num_battle_units + j] << ',';
+    for (std::uint32_t j = 0; j < num_battle_units; ++j)
+      std::cout << batch.sds[i * num_battle_units + j] << (j + 1 != num_battle_units ? ',' : '\n');
+  }
+}
+
+int predict_stdin(NnInfer *nn) {
+  const std::uint32_t num_battle_units = 2 * nn_infer_num_unit_kinds(nn);
+  Batch batch{};
+  std::string line;
+  for (std::uint64_t line_number = 1; std::getline(std::cin, line); ++line_number) {
+    if (line.empty() || !(line[0] >= '0' && line[0] <= '9'))
+      continue;
+
+    const char *p = line.c_str();
+    for (std::uint32_t i = 0; i < 2 * num_techs + num_battle_units; ++i) {
+      char *end = nullptr;
+      const double value = std::strtod(p, &end);
+      if (end == p || value < 0.0) {
+        std::cerr << "Failed to parse line " << line_number << '\n';
+        return 1;
+      }
+      if (i < 2 * num_techs)
+        batch.techs.push_back(static_cast<std::uint8_t>(std::min(value, 255.0)));
+      else
+        batch.units.push_back(static_cast<std::uint32_t>(value + 0.5));
+      p = *end == ',' ? end + 1 : end;
+    }
+
+    if (batch.size() == opt_batch_size) {
+      batch.predict(nn);
+      print_predictions(batch, num_battle_units);
+      batch.clear();
+    }
+  }
+  batch.predict(nn);
+  print_predictions(batch, num_battle_units);
+  return std::cout.good() ? 0 : 1;
+}
+
+// Bench
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+Batch random_battles(std::size_t num_battles, std::uint32_t num_unit_kinds, std::uint32_t seed) {
+  std::mt19937 rng{seed};
+  std::uniform_int_distribution<std::uint32_t> tech{0, 20};
+  std::uniform_int_distribution<std::uint32_t> ships{0, 10};
+  Batch batch{};
+  for (std::size_t i = 0; i < num_battles * 2 * num_techs; ++i)
+    batch.techs.push_back(static_cast<std::uint8_t>(tech(rng)));
+  for (std::size_t i = 0; i < num_battles * 2 * num_unit_kinds; ++i)
+    batch.units.push_back(ships(rng));
+  return batch;
+}
+
+// Times single battles on the calling thread, then batches of --batch-size battles on all threads.
+int bench(NnInfer *nn) {
+  const std::uint32_t num_unit_kinds = nn_infer_num_unit_kinds(nn);
+
+  Batch single = random_battles(1024, num_unit_kinds, 1);
+  std::vector<float> means(2 * num_unit_kinds);
+  std::vector<float> sds(2 * num_unit_kinds);
+  std::vector<double> latencies{};
+  auto start = std::chrono::steady_clock::now();
+  do {
+    const std::size_t i = latencies.size() % single.size();
+    const auto call_start = std::chrono::steady_clock::now();
+    nn_infer_predict(nn, 1, &single.techs[i * 2 * num_techs], &single.units[i * 2 * num_unit_kinds], means.data(),
+                     sds.data());
+    latencies.push_back(seconds_since(call_start) * 1e6);
+  } while (seconds_since(start) < opt_min_time);
+  std::ranges::sort(latencies);
+  double total_latency = 0.0;
+  for (double latency : latencies)
+    total_latency += latency;
+
+  Batch batch = random_battles(opt_batch_size, num_unit_kinds, 2);
+  std::uint64_t num_predictions = 0;
+  start = std::chrono::steady_clock::now();
+  do {
+    batch.predict(nn);
+    num_predictions += batch.size();
+  } while (seconds_since(start) < opt_min_time);
+  const double seconds = seconds_since(start);
+
+  std::cout << "{\n"
+            << "  \"model\": \"" << opt_model << "\",\n"
+            << "  \"precision\": \"" << nn_precision_names[static_cast<std::size_t>(opt_precision)] << "\",\n"
+            << "  \"num_threads\": " << opt_num_threads << ",\n"
+            << "  \"latency_us\": {\"mean\": " << total_latency / static_cast<double>(latencies.size())
+            << ", \"p50\": " << latencies[latencies.size() / 2]
+            << ", \"p99\": " << latencies[latencies.size() * 99 / 100] << "},\n"
+            << "  \"batch_size\": " << opt_batch_size << ",\n"
+            << "  \"predictions_per_sec\": " << static_cast<double>(num_predictions) / seconds << '\n'
+            << "}\n";
+  return 0;
+}
+
+} // namespace
+
+int main(int /*argc*/, const char *const *argv) {
+  parse_args(argv);
+  std::ios::sync_with_stdio(false);
+
+  // Resolved here rather than by the library, so that the bench prints the number of threads it runs with.
+  if (opt_num_threads == 0)
+    opt_num_threads = num_allowed_cpus();
+
+  const char *error = nullptr;
+  NnInfer *nn = nn_infer_create(opt_model, opt_precision == NnPrecision::Int8 ? NN_INFER_INT8 : NN_INFER_FLOAT32,
+                                opt_num_threads, &error);
+  if (nn == nullptr) {
+    std::cerr << "Failed to load model " << opt_model << ": " << error << '\n';
+    return 1;
+  }
+
+  const int status = opt_bench ? bench(nn) : predict_stdin(nn);
+  nn_infer_destroy(nn);
+  return status;
+}
@@ -0,0 +1,89 @@
+#include "NnInferApi.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "NnModel.hpp"
+#include "ThreadPool.hpp"
+
+using namespace dataset_gen;
+
+namespace {
+
+constexpr std::uint32_t num_techs = 3;
+
+} // namespace
+
+struct NnInfer {
+  NnModel model;
+  ThreadPool pool;
+  std::vector<NnWorkspace> workspaces;
+  std::mutex mutex{};
+
+  explicit NnInfer(std::uint32_t num_threads) : model{}, pool{num_threads}, workspaces(pool.num_threads()) {}
+};
+
+extern "C" {
+
+std::uint32_t nn_infer_api_version(void) { return NN_INFER_API_VERSION; }
+
+NnInfer *nn_infer_create(const char *model_path, std::uint32_t precision, std::uint32_t num_threads,
+                         const char **error) {
+  if (model_path == nullptr || precision > NN_INFER_INT8) {
+    if (error != nullptr)
+      *error = "Invalid argument";
+    return nullptr;
+  }
+  auto *nn = new NnInfer{num_threads};
+  if (!nn->model.open(model_path, precision == NN_INFER_INT8 ? NnPrecision::Int8 : NnPrecision::Float32)) {
+    if (error != nullptr)
+      *error = nn->model.error();
+    delete nn;
+    return nullptr;
+  }
+  if (nn->model.num_techs() != num_techs) {
+    if (error != nullptr)
+      *error = "The model does not take weapons, shielding and armor techs";
+    delete nn;
+    return nullptr;
+  }
+  return nn;
+}
+
+void nn_infer_destroy(NnInfer *nn) { delete nn; }
+
+std::uint32_t nn_infer_num_unit_kinds(const NnInfer *nn) { return nn != nullptr ? nn->model.num_unit_kinds() : 0; }
+
+int nn_infer_predict(NnInfer *nn, std::size_t num_battles, const std::uint8_t *techs, const std::uint32_t *units,
+                     float *means, float *sds) {
+  if (nn == nullptr)
+    return NN_INFER_INVALID_ARGUMENT;
+  if (num_battles == 0)
+    return NN_INFER_OK;
+  if (techs == nullptr || units == nullptr || means == nullptr || sds == nullptr)
+    return NN_INFER_INVALID_ARGUMENT;
+
+  std::lock_guard lock{nn->mutex};
+  const NnModel &model = nn->model;
+  // A single block is not worth waking up the pool for.
+  if (num_battles <= nn_block_rows || nn->pool.num_threads() == 1) {
+    model.predict(nn->workspaces[0], num_battles, techs, units, means, sds);
+    return NN_INFER_OK;
+  }
+
+  const std::size_t num_battle_techs = 2 * num_techs;
+  const std::size_t num_units = 2 * model.num_unit_kinds();
+  const std::size_t num_blocks = (num_battles + nn_block_rows - 1) / nn_block_rows;
+  nn->pool.run(num_blocks, [&](std::uint32_t thread, std::size_t block) {
+    const std::size_t begin = block * nn_block_rows;
+    const std::size_t n = std::min<std::size_t>(nn_block_rows, num_battles - begin);
+    model.predict(nn->workspaces[thread], n, techs + begin * num_battle_techs, units + begin * num_units,
+                  means + begin * num_units, sds + begin * num_units);
+  });
+  return NN_INFER_OK;
+}
+
+} // extern "C"
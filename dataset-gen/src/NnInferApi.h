@@ -0,0 +1,59 @@
+#ifndef DATASET_GEN_NN_INFER_API_H
+#define DATASET_GEN_NN_INFER_API_H
+
+// C API of the neural network inference library (libnn-infer), which runs the model trained by train.py and exported
+// by export-model.py without TensorFlow.
+//
+// Battles are passed as contiguous arrays, battle after battle, the attacker before the defender:
+//   techs:  uint8_t[num_battles][2][3], weapons, shielding and armor
+//   units:  uint32_t[num_battles][2][nn_infer_num_unit_kinds()]
+// and the predictions are written into caller buffers of the same shape as units:
+//   means, sds: float[num_battles][2][nn_infer_num_unit_kinds()]
+// with the predicted mean and standard deviation of the units left. The inputs and outputs are scaled with the scales
+// saved by train.py, as battle.py does.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define NN_INFER_EXPORT __declspec(dllexport)
+#else
+#define NN_INFER_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NN_INFER_API_VERSION 1
+
+#define NN_INFER_OK 0
+#define NN_INFER_INVALID_ARGUMENT (-1)
+
+#define NN_INFER_FLOAT32 0
+#define NN_INFER_INT8 1
+
+typedef struct NnInfer NnInfer;
+
+NN_INFER_EXPORT uint32_t nn_infer_api_version(void);
+
+// Maps the model file and prepares num_threads threads, 0 for one per available CPU. With NN_INFER_INT8 precision the
+// weights are quantized to int8. Returns NULL if the model cannot be loaded, with the reason in *error if error is not
+// NULL.
+NN_INFER_EXPORT NnInfer *nn_infer_create(const char *model_path, uint32_t precision, uint32_t num_threads,
+                                         const char **error);
+
+NN_INFER_EXPORT void nn_infer_destroy(NnInfer *nn);
+
+NN_INFER_EXPORT uint32_t nn_infer_num_unit_kinds(const NnInfer *nn);
+
+// Predicts the battles. Small batches run on the calling thread; larger ones are split over the threads. Calls from
+// several threads on the same instance are serialized.
+NN_INFER_EXPORT int nn_infer_predict(NnInfer *nn, size_t num_battles, const uint8_t *techs, const uint32_t *units,
+                                     float *means, float *sds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // !DATASET_GEN_NN_INFER_API_H
@@ -0,0 +1,580 @@
+#include "NnModel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// The GEMM kernels have three implementations, selected at compile time like the unit passes of the battle engine:
+// AVX-512, AVX2 with FMA and a scalar fallback. The int8 kernels use VNNI when the target has it; their sums are exact,
+// so all implementations give the same int8 results.
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#define DATASET_GEN_NN_AVX512 1
+#elif defined(__AVX2__) && defined(__FMA__)
+#define DATASET_GEN_NN_AVX2 1
+#endif
+
+namespace dataset_gen {
+
+namespace {
+
+constexpr std::uint32_t round_up(std::uint32_t n, std::uint32_t m) { return (n + m - 1) / m * m; }
+
+// Inputs per K block of the float GEMM: the weights of a tile for 256 inputs take 16 or 32 KiB and stay in L1 while
+// the tile sweeps over the rows.
+constexpr std::uint32_t k_block = 256;
+
+// Vector lanes of the kernels. A tile computes tile_rows rows of tile_panels panels, with every accumulator in a
+// register.
+
+#if defined(DATASET_GEN_NN_AVX512)
+DATASET_GEN_AVX512_BEGIN
+
+struct FloatLanes {
+  using Vec = __m512;
+  static constexpr std::uint32_t width = 16;
+  static constexpr std::uint32_t tile_rows = 8;
+  static constexpr std::uint32_t tile_panels = 2;
+
+  static Vec load(const float *p) { return _mm512_load_ps(p); }
+  static Vec broadcast(float x) { return _mm512_set1_ps(x); }
+  static Vec fma(Vec a, Vec b, Vec c) { return _mm512_fmadd_ps(a, b, c); }
+  static Vec relu(Vec a) { return _mm512_max_ps(a, _mm512_setzero_ps()); }
+  static void store(float *p, Vec a) { _mm512_store_ps(p, a); }
+};
+
+struct IntLanes {
+  using Vec = __m512i;
+  static constexpr std::uint32_t width = 16;
+  static constexpr std::uint32_t tile_rows = 8;
+  static constexpr std::uint32_t tile_panels = 2;
+
+  static Vec zero() { return _mm512_setzero_si512(); }
+  static Vec load(const std::int8_t *p) { return _mm512_load_si512(p); }
+  static Vec broadcast(const std::uint8_t *p) {
+    std::int32_t x;
+    std::memcpy(&x, p, sizeof(x));
+    return _mm512_set1_epi32(x);
+  }
+  // Adds the dot products of the 4 unsigned bytes of a with the 4 signed bytes of b in each lane to acc. Activations
+  // are at most 127, so the pairwise sums of maddubs cannot saturate.
+  static Vec dot(Vec acc, Vec a, Vec b) {
+#if defined(__AVX512VNNI__)
+    return _mm512_dpbusd_epi32(acc, a, b);
+#else
+    return _mm512_add_epi32(acc, _mm512_madd_epi16(_mm512_maddubs_epi16(a, b), _mm512_set1_epi16(1)));
+#endif
+  }
+  static void store(std::int32_t *p, Vec a) { _mm512_store_si512(p, a); }
+};
+
+DATASET_GEN_AVX512_END
+#elif defined(DATASET_GEN_NN_AVX2)
+struct FloatLanes {
+  using Vec = __m256;
+  static constexpr std::uint32_t width = 8;
+  static constexpr std::uint32_t tile_rows = 6;
+  static constexpr std::uint32_t tile_panels = 1;
+
+  static Vec load(const float *p) { return _mm256_load_ps(p); }
+  static Vec broadcast(float x) { return _mm256_set1_ps(x); }
+  static Vec fma(Vec a, Vec b, Vec c) { return _mm256_fmadd_ps(a, b, c); }
+  static Vec relu(Vec a) { return _mm256_max_ps(a, _mm256_setzero_ps()); }
+  static void store(float *p, Vec a) { _mm256_store_ps(p, a); }
+};
+
+struct IntLanes {
+  using Vec = __m256i;
+  static constexpr std::uint32_t width = 8;
+  static constexpr std::uint32_t tile_rows = 6;
+  static constexpr std::uint32_t tile_panels = 1;
+
+  static Vec zero() { return _mm256_setzero_si256(); }
+  static Vec load(const std::int8_t *p) { return _mm256_load_si256(reinterpret_cast<const __m256i *>(p)); }
+  static Vec broadcast(const std::uint8_t *p) {
+    std::int32_t x;
+    std::memcpy(&x, p, sizeof(x));
+    return _mm256_set1_epi32(x);
+  }
+  static Vec dot(Vec acc, Vec a, Vec b) {
+#if defined(__AVXVNNI__)
+    return _mm256_dpbusd_avx_epi32(acc, a, b);
+#else
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(a, b), _mm256_set1_epi16(1)));
+#endif
+  }
+  static void store(std::int32_t *p, Vec a) { _mm256_store_si256(reinterpret_cast<__m256i *>(p), a); }
+};
+#else
+struct FloatLanes {
+  using Vec = float;
+  static constexpr std::uint32_t width = 1;
+  static constexpr std::uint32_t tile_rows = 4;
+  static constexpr std::uint32_t tile_panels = 1;
+
+  static Vec load(const float *p) { return *p; }
+  static Vec broadcast(float x) { return x; }
+  static Vec fma(Vec a, Vec b, Vec c) { return a * b + c; }
+  static Vec relu(Vec a) { return std::max(a, 0.0f); }
+  static void store(float *p, Vec a) { *p = a; }
+};
+
+// Loads and broadcasts hold 4 packed bytes, accumulators an int32 sum.
+struct IntLanes {
+  using Vec = std::int32_t;
+  static constexpr std::uint32_t width = 1;
+  static constexpr std::uint32_t tile_rows = 4;
+  static constexpr std::uint32_t tile_panels = 1;
+
+  static Vec zero() { return 0; }
+  static Vec load(const std::int8_t *p) {
+    std::int32_t x;
+    std::memcpy(&x, p, sizeof(x));
+    return x;
+  }
+  static Vec broadcast(const std::uint8_t *p) {
+    std::int32_t x;
+    std::memcpy(&x, p, sizeof(x));
+    return x;
+  }
+  static Vec dot(Vec acc, Vec a, Vec b) {
+    for (std::uint32_t i = 0; i < 4; ++i) {
+      const auto a_byte = static_cast<std::uint8_t>(static_cast<std::uint32_t>(a) >> (8 * i));
+      const auto b_byte = static_cast<std::int8_t>(static_cast<std::uint32_t>(b) >> (8 * i));
+      acc += a_byte * b_byte;
+    }
+    return acc;
+  }
+  static void store(std::int32_t *p, Vec a) { *p = a; }
+};
+#endif
+
+// Float GEMM
+
+struct FloatTileArgs {
+  const float *a;
+  std::size_t lda;
+  const float *b;
+  std::size_t panel_stride;
+  std::uint32_t k_begin;
+  std::uint32_t k_end;
+  float *c;
+  std::size_t ldc;
+  // Starting value of C in the first K block; the later blocks add to C.
+  const float *bias;
+  // Applied in the last K block.
+  bool relu;
+};
+
+// C[Rows][Panels * 16] += A[Rows][k_begin, k_end) * B[k_begin, k_end)[Panels * 16].
+template <std::uint32_t Rows, std::uint32_t Panels> void float_tile(const FloatTileArgs &args) {
+  using L = FloatLanes;
+  constexpr std::uint32_t panel_vecs = model_panel_width / L::width;
+  constexpr std::uint32_t vecs = Panels * panel_vecs;
+
+  typename L::Vec acc[Rows][vecs];
+  for (std::uint32_t r = 0; r < Rows; ++r) {
+    for (std::uint32_t v = 0; v < vecs; ++v)
+      acc[r][v] = L::load(args.bias != nullptr ? args.bias + v * L::width : args.c + r * args.ldc + v * L::width);
+  }
+
+  for (std::uint32_t k = args.k_begin; k < args.k_end; ++k) {
+    typename L::Vec w[vecs];
+    for (std::uint32_t v = 0; v < vecs; ++v)
+      w[v] = L::load(args.b + v / panel_vecs * args.panel_stride + k * model_panel_width + v % panel_vecs * L::width);
+    for (std::uint32_t r = 0; r < Rows; ++r) {
+      const typename L::Vec x = L::broadcast(args.a[r * args.lda + k]);
+      for (std::uint32_t v = 0; v < vecs; ++v)
+        acc[r][v] = L::fma(x, w[v], acc[r][v]);
+    }
+  }
+
+  for (std::uint32_t r = 0; r < Rows; ++r) {
+    for (std::uint32_t v = 0; v < vecs; ++v)
+      L::store(args.c + r * args.ldc + v * L::width, args.relu ? L::relu(acc[r][v]) : acc[r][v]);
+  }
+}
+
+// Tiles for every number of rows and panels up to the full tile, indexed [panels - 1][rows - 1], for the edges.
+
+using FloatTileFn = void (*)(const FloatTileArgs &);
+
+template <std::uint32_t Panels, std::size_t... Rows>
+constexpr std::array<FloatTileFn, sizeof...(Rows)> make_float_tiles(std::index_sequence<Rows...>) {
+  return {&float_tile<static_cast<std::uint32_t>(Rows) + 1, Panels>...};
+}
+
+template <std::size_t... Panels>
+constexpr std::array<std::array<FloatTileFn, FloatLanes::tile_rows>, sizeof...(Panels)>
+make_float_tile_table(std::index_sequence<Panels...>) {
+  return {
+      make_float_tiles<static_cast<std::uint32_t>(Panels) + 1>(std::make_index_sequence<FloatLanes::tile_rows>{})...};
+}
+
+constexpr auto float_tiles = make_float_tile_table(std::make_index_sequence<FloatLanes::tile_panels>{});
+
+// Goto-style blocking: for every K block, each tile of panels is kept in L1 while it sweeps over the rows of the block
+// of battles, whose activations are in L2.
+void dense_float(const NnLayer &layer, const float *a, float *c, std::size_t ld, std::uint32_t num_rows) {
+  const std::size_t panel_stride = std::size_t{layer.num_inputs} * model_panel_width;
+  for (std::uint32_t k_begin = 0; k_begin < layer.num_inputs; k_begin += k_block) {
+    const std::uint32_t k_end = std::min(k_begin + k_block, layer.num_inputs);
+    for (std::uint32_t panel = 0; panel < layer.num_panels; panel += FloatLanes::tile_panels) {
+      const std::uint32_t num_panels = std::min(FloatLanes::tile_panels, layer.num_panels - panel);
+      const std::size_t column = std::size_t{panel} * model_panel_width;
+      for (std::uint32_t row = 0; row < num_rows; row += FloatLanes::tile_rows) {
+        const std::uint32_t rows = std::min(FloatLanes::tile_rows, num_rows - row);
+        float_tiles[num_panels - 1][rows - 1]({
+            .a = a + row * ld,
+            .lda = ld,
+            .b = layer.weights + panel * panel_stride,
+            .panel_stride = panel_stride,
+            .k_begin = k_begin,
+            .k_end = k_end,
+            .c = c + row * ld + column,
+            .ldc = ld,
+            .bias = k_begin == 0 ? layer.biases + column : nullptr,
+            .relu = layer.relu && k_end == layer.num_inputs,
+        });
+      }
+    }
+  }
+}
+
+// Int8 GEMM
+//
+// A layer has at most a few thousand inputs, so the int8 weights of a whole tile fit in L1 and K is not blocked.
+
+struct IntTileArgs {
+  const std::uint8_t *a;
+  std::size_t lda;
+  const float *row_scales;
+  const std::int8_t *b;
+  std::size_t panel_stride;
+  std::uint32_t num_quads;
+  const float *weight_scales;
+  const float *bias;
+  float *c;
+  std::size_t ldc;
+  bool relu;
+};
+
+// C[Rows][Panels * 16] = A[Rows] * B[Panels * 16] * row scale * weight scale + bias.
+template <std::uint32_t Rows, std::uint32_t Panels> void int8_tile(const IntTileArgs &args) {
+  using L = IntLanes;
+  constexpr std::uint32_t panel_vecs = model_panel_width / L::width;
+  constexpr std::uint32_t vecs = Panels * panel_vecs;
+  constexpr std::uint32_t quad_bytes = model_panel_width * 4;
+
+  typename L::Vec acc[Rows][vecs];
+  for (std::uint32_t r = 0; r < Rows; ++r) {
+    for (std::uint32_t v = 0; v < vecs; ++v)
+      acc[r][v] = L::zero();
+  }
+
+  for (std::uint32_t q = 0; q < args.num_quads; ++q) {
+    typename L::Vec w[vecs];
+    for (std::uint32_t v = 0; v < vecs; ++v)
+      w[v] = L::load(args.b + v / panel_vecs * args.panel_stride + q * quad_bytes + v % panel_vecs * L::width * 4);
+    for (std::uint32_t r = 0; r < Rows; ++r) {
+      const typename L::Vec x = L::broadcast(args.a + r * args.lda + q * 4);
+      for (std::uint32_t v = 0; v < vecs; ++v)
+        acc[r][v] = L::dot(acc[r][v], x, w[v]);
+    }
+  }
+
+  alignas(64) std::int32_t sums[vecs * L::width];
+  for (std::uint32_t r = 0; r < Rows; ++r) {
+    for (std::uint32_t v = 0; v < vecs; ++v)
+      L::store(sums + v * L::width, acc[r][v]);
+    float *c = args.c + r * args.ldc;
+    for (std::uint32_t o = 0; o < Panels * model_panel_width; ++o) {
+      const float y = static_cast<float>(sums[o]) * args.row_scales[r] * args.weight_scales[o] + args.bias[o];
+      c[o] = args.relu ? std::max(y, 0.0f) : y;
+    }
+  }
+}
+
+using IntTileFn = void (*)(const IntTileArgs &);
+
+template <std::uint32_t Panels, std::size_t... Rows>
+constexpr std::array<IntTileFn, sizeof...(Rows)> make_int8_tiles(std::index_sequence<Rows...>) {
+  return {&int8_tile<static_cast<std::uint32_t>(Rows) + 1, Panels>...};
+}
+
+template <std::size_t... Panels>
+constexpr std::array<std::array<IntTileFn, IntLanes::tile_rows>, sizeof...(Panels)>
+make_int8_tile_table(std::index_sequence<Panels...>) {
+  return {make_int8_tiles<static_cast<std::uint32_t>(Panels) + 1>(std::make_index_sequence<IntLanes::tile_rows>{})...};
+}
+
+constexpr auto int8_tiles = make_int8_tile_table(std::make_index_sequence<IntLanes::tile_panels>{});
+
+// Quantizes every row to [0, 127] with its own scale. The inputs of all layers are non-negative: the scaled battle
+// inputs and the outputs of ReLU layers (open() checks that the hidden layers are ReLU).
+void quantize_rows(const float *a, std::size_t ld, std::uint32_t num_inputs, std::uint32_t num_rows, std::uint8_t *q,
+                   float *row_scales) {
+  const std::uint32_t padded_inputs = round_up(num_inputs, 4);
+  for (std::uint32_t r = 0; r < num_rows; ++r) {
+    const float *row = a + r * ld;
+    const float max = std::max(*std::max_element(row, row + num_inputs), 0.0f);
+    const float inverse = max > 0.0f ? 127.0f / max : 0.0f;
+    std::uint8_t *q_row = q + r * ld;
+    for (std::uint32_t k = 0; k < num_inputs; ++k)
+      q_row[k] = static_cast<std::uint8_t>(std::min(std::max(row[k], 0.0f) * inverse + 0.5f, 127.0f));
+    std::fill(q_row + num_inputs, q_row + padded_inputs, std::uint8_t{0});
+    row_scales[r] = max / 127.0f;
+  }
+}
+
+void dense_int8(const NnLayer &layer, const std::uint8_t *q, const float *row_scales, float *c, std::size_t ld,
+                std::uint32_t num_rows) {
+  const std::uint32_t num_quads = round_up(layer.num_inputs, 4) / 4;
+  const std::size_t panel_stride = std::size_t{num_quads} * model_panel_width * 4;
+  for (std::uint32_t panel = 0; panel < layer.num_panels; panel += IntLanes::tile_panels) {
+    const std::uint32_t num_panels = std::min(IntLanes::tile_panels, layer.num_panels - panel);
+    const std::size_t column = std::size_t{panel} * model_panel_width;
+    for (std::uint32_t row = 0; row < num_rows; row += IntLanes::tile_rows) {
+      const std::uint32_t rows = std::min(IntLanes::tile_rows, num_rows - row);
+      int8_tiles[num_panels - 1][rows - 1]({
+          .a = q + row * ld,
+          .lda = ld,
+          .row_scales = row_scales + row,
+          .b = layer.quantized_weights + panel * panel_stride,
+          .panel_stride = panel_stride,
+          .num_quads = num_quads,
+          .weight_scales = layer.weight_scales + column,
+          .bias = layer.biases + column,
+          .c = c + row * ld + column,
+          .ldc = ld,
+          .relu = layer.relu,
+      });
+    }
+  }
+}
+
+bool is_within(std::uint64_t offset, std::uint64_t size, std::uint64_t file_size) {
+  return offset % model_alignment == 0 && offset <= file_size && size <= file_size - offset;
+}
+
+} // namespace
+
+NnModel::~NnModel() {
+  if (mapping_ != nullptr)
+    ::munmap(mapping_, mapping_size_);
+}
+
+bool NnModel::fail(const char *error) {
+  error_ = error;
+  return false;
+}
+
+bool NnModel::open(const char *path, NnPrecision precision) {
+  precision_ = precision;
+
+  const int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return fail("Failed to open the model file");
+  struct stat st {};
+  if (::fstat(fd, &st) != 0 || static_cast<std::uint64_t>(st.st_size) < sizeof(ModelFileHeader)) {
+    ::close(fd);
+    return fail("The model file is too short");
+  }
+  mapping_size_ = static_cast<std::size_t>(st.st_size);
+  mapping_ = ::mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping_ == MAP_FAILED) {
+    mapping_ = nullptr;
+    return fail("Failed to map the model file");
+  }
+
+  const auto *base = static_cast<const std::byte *>(mapping_);
+  std::memcpy(&header_, base, sizeof(header_));
+  if (std::memcmp(header_.magic, model_magic, sizeof(model_magic)) != 0)
+    return fail("Not a model file");
+  if (header_.version != model_version)
+    return fail("Unsupported model file version");
+  if (header_.alignment != model_alignment || header_.num_layers == 0 || header_.num_unit_kinds == 0 ||
+      header_.header_size < sizeof(ModelFileHeader) + std::uint64_t{header_.num_layers} * sizeof(ModelLayerDesc) ||
+      header_.header_size > mapping_size_)
+    return fail("Corrupted model file header");
+  if (!(header_.tech_scale > 0.0 && header_.ships_scale > 0.0 && header_.mean_scale > 0.0 && header_.sd_scale > 0.0))
+    return fail("Invalid scales in the model file");
+
+  layers_.resize(header_.num_layers);
+  max_width_ = round_up(num_inputs(), model_panel_width);
+  std::uint32_t num_layer_inputs = num_inputs();
+  for (std::uint32_t i = 0; i < header_.num_layers; ++i) {
+    ModelLayerDesc desc;
+    std::memcpy(&desc, base + sizeof(ModelFileHeader) + i * sizeof(ModelLayerDesc), sizeof(desc));
+    if (desc.num_inputs != num_layer_inputs || desc.num_outputs == 0 ||
+        desc.activation > static_cast<std::uint32_t>(ModelActivation::Relu))
+      return fail("Invalid layer in the model file");
+    const std::uint32_t num_panels = round_up(desc.num_outputs, model_panel_width) / model_panel_width;
+    const std::uint64_t weights_size = std::uint64_t{num_panels} * model_panel_width * desc.num_inputs * sizeof(float);
+    const std::uint64_t biases_size = std::uint64_t{num_panels} * model_panel_width * sizeof(float);
+    if (!is_within(desc.weights_offset, weights_size, mapping_size_) ||
+        !is_within(desc.biases_offset, biases_size, mapping_size_))
+      return fail("Layer out of the model file");
+
+    layers_[i] = NnLayer{
+        .num_inputs = desc.num_inputs,
+        .num_outputs = desc.num_outputs,
+        .num_panels = num_panels,
+        .relu = desc.activation == static_cast<std::uint32_t>(ModelActivation::Relu),
+        .weights = reinterpret_cast<const float *>(base + desc.weights_offset),
+        .biases = reinterpret_cast<const float *>(base + desc.biases_offset),
+        .quantized_weights = nullptr,
+        .weight_scales = nullptr,
+    };
+    max_width_ = std::max(max_width_, num_panels * model_panel_width);
+    num_layer_inputs = desc.num_outputs;
+  }
+  if (num_layer_inputs != num_outputs())
+    return fail("The model does not output means and standard deviations of all unit kinds");
+
+  if (precision_ == NnPrecision::Int8) {
+    if (std::any_of(layers_.begin(), layers_.end() - 1, [](const NnLayer &layer) { return !layer.relu; }))
+      return fail("Int8 inference needs ReLU hidden layers");
+    quantize_weights();
+  } else {
+    ::madvise(mapping_, mapping_size_, MADV_WILLNEED);
+  }
+  return true;
+}
+
+// Quantizes the weights of every output to [-127, 127] with its own scale, into the layout read by int8_tile: groups
+// of 4 consecutive inputs of an output are adjacent, for the 4-byte dot products.
+void NnModel::quantize_weights() {
+  std::size_t num_weights = 0;
+  std::size_t num_scales = 0;
+  for (const NnLayer &layer : layers_) {
+    num_weights += std::size_t{layer.num_panels} * round_up(layer.num_inputs, 4) * model_panel_width;
+    num_scales += std::size_t{layer.num_panels} * model_panel_width;
+  }
+  quantized_weights_.assign(num_weights, 0);
+  weight_scales_.assign(num_scales, 0.0f);
+
+  std::int8_t *q = quantized_weights_.data();
+  float *scales = weight_scales_.data();
+  for (NnLayer &layer : layers_) {
+    const std::uint32_t padded_inputs = round_up(layer.num_inputs, 4);
+    for (std::uint32_t panel = 0; panel < layer.num_panels; ++panel) {
+      const float *w = layer.weights + std::size_t{panel} * layer.num_inputs * model_panel_width;
+      std::int8_t *q_panel = q + std::size_t{panel} * padded_inputs * model_panel_width;
+      for (std::uint32_t o = 0; o < model_panel_width; ++o) {
+        float max = 0.0f;
+        for (std::uint32_t k = 0; k < layer.num_inputs; ++k)
+          max = std::max(max, std::abs(w[k * model_panel_width + o]));
+        const float inverse = max > 0.0f ? 127.0f / max : 0.0f;
+        for (std::uint32_t k = 0; k < layer.num_inputs; ++k) {
+          q_panel[k / 4 * model_panel_width * 4 + o * 4 + k % 4] =
+              static_cast<std::int8_t>(std::lround(w[k * model_panel_width + o] * inverse));
+        }
+        scales[panel * model_panel_width + o] = max / 127.0f;
+      }
+    }
+    layer.quantized_weights = q;
+    layer.weight_scales = scales;
+    q += std::size_t{layer.num_panels} * padded_inputs * model_panel_width;
+    scales += std::size_t{layer.num_panels} * model_panel_width;
+  }
+}
+
+void NnModel::prepare(NnWorkspace &workspace) const {
+  const std::size_t size = std::size_t{nn_block_rows} * max_width_;
+  for (auto &activations : workspace.activations) {
+    if (activations.size() < size)
+      activations.resize(size);
+  }
+  if (precision_ == NnPrecision::Int8 && workspace.quantized.size() < size)
+    workspace.quantized.resize(size);
+  if (workspace.row_scales.size() < nn_block_rows) {
+    workspace.row_scales.resize(nn_block_rows);
+    workspace.ship_scales.resize(nn_block_rows);
+  }
+}
+
+const float *NnModel::run_layers(NnWorkspace &workspace, std::uint32_t num_rows) const {
+  const std::size_t ld = max_width_;
+  std::size_t in = 0;
+  for (const NnLayer &layer : layers_) {
+    const float *a = workspace.activations[in].data();
+    float *c = workspace.activations[in ^ 1].data();
+    if (precision_ == NnPrecision::Int8) {
+      quantize_rows(a, ld, layer.num_inputs, num_rows, workspace.quantized.data(), workspace.row_scales.data());
+      dense_int8(layer, workspace.quantized.data(), workspace.row_scales.data(), c, ld, num_rows);
+    } else {
+      dense_float(layer, a, c, ld, num_rows);
+    }
+    in ^= 1;
+  }
+  return workspace.activations[in].data();
+}
+
+void NnModel::predict(NnWorkspace &workspace, std::size_t num_battles, const std::uint8_t *techs,
+                      const std::uint32_t *units, float *means, float *sds) const {
+  prepare(workspace);
+  const std::size_t ld = max_width_;
+  const std::uint32_t num_battle_techs = 2 * num_techs();
+  const std::uint32_t num_battle_units = 2 * num_unit_kinds();
+  const double max_ships = 1.0 / header_.ships_scale;
+
+  for (std::size_t begin = 0; begin < num_battles; begin += nn_block_rows) {
+    const auto num_rows = static_cast<std::uint32_t>(std::min<std::size_t>(nn_block_rows, num_battles - begin));
+
+    for (std::uint32_t r = 0; r < num_rows; ++r) {
+      const std::uint8_t *battle_techs = techs + (begin + r) * num_battle_techs;
+      const std::uint32_t *battle_units = units + (begin + r) * num_battle_units;
+      float *row = workspace.activations[0].data() + r * ld;
+      for (std::uint32_t i = 0; i < num_battle_techs; ++i)
+        row[i] = static_cast<float>(battle_techs[i] * header_.tech_scale);
+      // Battles with more ships than any in the dataset are scaled down to its largest, as make_input does.
+      const std::uint32_t most_ships = *std::max_element(battle_units, battle_units + num_battle_units);
+      const double scale = most_ships > max_ships ? max_ships / most_ships : 1.0;
+      for (std::uint32_t i = 0; i < num_battle_units; ++i)
+        row[num_battle_techs + i] = static_cast<float>(battle_units[i] * header_.ships_scale * scale);
+      workspace.ship_scales[r] = scale;
+    }
+
+    const float *outputs = run_layers(workspace, num_rows);
+
+    for (std::uint32_t r = 0; r < num_rows; ++r) {
+      const float *row = outputs + r * ld;
+      const double scale = workspace.ship_scales[r];
+      float *battle_means = means + (begin + r) * num_battle_units;
+      float *battle_sds = sds + (begin + r) * num_battle_units;
+      for (std::uint32_t i = 0; i < num_battle_units; ++i) {
+        battle_means[i] = static_cast<float>(row[i] / (header_.mean_scale * scale));
+        battle_sds[i] = static_cast<float>(row[num_battle_units + i] / (header_.sd_scale * scale));
+      }
+    }
+  }
+}
+
+void NnModel::forward(NnWorkspace &workspace, std::size_t num_rows, const float *inputs, float *outputs) const {
+  prepare(workspace);
+  const std::size_t ld = max_width_;
+  for (std::size_t begin = 0; begin < num_rows; begin += nn_block_rows) {
+    const auto block_rows = static_cast<std::uint32_t>(std::min<std::size_t>(nn_block_rows, num_rows - begin));
+    for (std::uint32_t r = 0; r < block_rows; ++r)
+      std::copy_n(inputs + (begin + r) * num_inputs(), num_inputs(), workspace.activations[0].data() + r * ld);
+    const float *block_outputs = run_layers(workspace, block_rows);
+    for (std::uint32_t r = 0; r < block_rows; ++r)
+      std::copy_n(block_outputs + r * ld, num_outputs(), outputs + (begin + r) * num_outputs());
+  }
+}
+
+} // namespace dataset_gen
@@ -0,0 +1,148 @@
+#ifndef DATASET_GEN_NN_MODEL_HPP
+#define DATASET_GEN_NN_MODEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Util.hpp"
+
+namespace dataset_gen {
+
+// Model file format
+//
+// Written by export-model.py from the Keras model and the scales file of train.py. The file starts with a
+// ModelFileHeader, followed by num_layers ModelLayerDescs, one per Dense layer. The kernel of every layer is stored in
+// panels of model_panel_width outputs: panel p holds the weights of outputs [16p, 16p + 16) as
+// float32[num_inputs][16], with the outputs past num_outputs zeroed, so that the GEMM streams each panel contiguously.
+// The biases are float32[num_panels * 16], zero padded too. Offsets are aligned to model_alignment, so the weights are
+// used straight from the mapping of the file.
+//
+// The network maps the inputs of a dataset row (the techs of both combatants, then their units, scaled as make_input
+// in battle.py) to the means of both combatants followed by their standard deviations.
+
+constexpr char model_magic[8] = {'O', 'G', 'N', 'N', 'M', 'O', 'D', 'L'};
+constexpr std::uint32_t model_version = 1;
+constexpr std::uint32_t model_alignment = 64;
+constexpr std::uint32_t model_panel_width = 16;
+
+enum class ModelActivation : std::uint32_t {
+  Linear = 0,
+  Relu = 1,
+};
+
+struct ModelFileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t header_size;
+  std::uint32_t num_layers;
+  std::uint32_t num_techs;
+  std::uint32_t num_unit_kinds;
+  std::uint32_t alignment;
+  double tech_scale;
+  double ships_scale;
+  double mean_scale;
+  double sd_scale;
+};
+
+struct ModelLayerDesc {
+  std::uint32_t num_inputs;
+  std::uint32_t num_outputs;
+  std::uint32_t activation;
+  std::uint32_t reserved;
+  std::uint64_t weights_offset;
+  std::uint64_t biases_offset;
+};
+
+static_assert(sizeof(ModelFileHeader) == 64);
+static_assert(sizeof(ModelLayerDesc) == 32);
+
+// Inference
+
+enum class NnPrecision {
+  Float32,
+  // Weights quantized per output and activations per battle to int8, with int32 accumulation. About 4x less weight
+  // traffic than float32, at the cost of some accuracy.
+  Int8,
+};
+
+inline constexpr const char *nn_precision_names[] = {"float32", "int8"};
+
+// Battles are run through the network in blocks of this many rows, so that the activations of a block stay in L2
+// while the weights stream through L1.
+constexpr std::uint32_t nn_block_rows = 64;
+
+// Activation buffers of one thread.
+struct NnWorkspace {
+  AlignedVector<float> activations[2]{};
+  AlignedVector<std::uint8_t> quantized{};
+  std::vector<float> row_scales{};
+  std::vector<double> ship_scales{};
+};
+
+// A Dense layer, with the weights in the panel layout of the model file.
+struct NnLayer {
+  std::uint32_t num_inputs;
+  std::uint32_t num_outputs;
+  std::uint32_t num_panels;
+  bool relu;
+  const float *weights;
+  const float *biases;
+  // Int8 only: the weights as int8[num_panels][num_inputs / 4][16][4], with num_inputs rounded up to 4, and the scale
+  // of every output.
+  const std::int8_t *quantized_weights;
+  const float *weight_scales;
+};
+
+class NnModel {
+public:
+  NnModel() = default;
+  NnModel(const NnModel &) = delete;
+  NnModel &operator=(const NnModel &) = delete;
+  ~NnModel();
+
+  // Maps the model file. Returns false and sets error() if it cannot be read, is not a valid model or cannot be run
+  // with the precision.
+  bool open(const char *path, NnPrecision precision);
+
+  const char *error() const { return error_; }
+
+  NnPrecision precision() const { return precision_; }
+  std::uint32_t num_layers() const { return static_cast<std::uint32_t>(layers_.size()); }
+  std::uint32_t num_techs() const { return header_.num_techs; }
+  std::uint32_t num_unit_kinds() const { return header_.num_unit_kinds; }
+  std::uint32_t num_inputs() const { return 2 * (header_.num_techs + header_.num_unit_kinds); }
+  std::uint32_t num_outputs() const { return 4 * header_.num_unit_kinds; }
+
+  // Predicts the battles, laid out as in the C API (NnInferApi.h):
+  //   techs: uint8_t[num_battles][2][num_techs()], units: uint32_t[num_battles][2][num_unit_kinds()]
+  //   means, sds: float[num_battles][2][num_unit_kinds()]
+  // Scales the inputs as make_input and the outputs as dump_results in battle.py.
+  void predict(NnWorkspace &workspace, std::size_t num_battles, const std::uint8_t *techs, const std::uint32_t *units,
+               float *means, float *sds) const;
+
+  // Runs the network on inputs already scaled: inputs float[num_rows][num_inputs()] to outputs
+  // float[num_rows][num_outputs()].
+  void forward(NnWorkspace &workspace, std::size_t num_rows, const float *inputs, float *outputs) const;
+
+private:
+  bool fail(const char *error);
+  void quantize_weights();
+  void prepare(NnWorkspace &workspace) const;
+  // Runs the layers on the first num_rows rows of workspace.activations[0]; returns the buffer holding the outputs.
+  const float *run_layers(NnWorkspace &workspace, std::uint32_t num_rows) const;
+
+  NnPrecision precision_ = NnPrecision::Float32;
+  void *mapping_ = nullptr;
+  std::size_t mapping_size_ = 0;
+  ModelFileHeader header_{};
+  std::vector<NnLayer> layers_{};
+  std::uint32_t max_width_ = 0;
+  AlignedVector<std::int8_t> quantized_weights_{};
+  std::vector<float> weight_scales_{};
+  const char *error_ = nullptr;
+};
+
+} // namespace dataset_gen
+
+#endif // !DATASET_GEN_NN_MODEL_HPP
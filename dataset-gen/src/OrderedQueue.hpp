@@ -0,0 +1,52 @@
+#ifndef DATASET_GEN_ORDERED_QUEUE_HPP
+#define DATASET_GEN_ORDERED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace dataset_gen {
+
+// Blocking queue of indexed items that are pushed in any order and popped in index order.
+// push() waits while the item is more than capacity items ahead of the next one to pop, which bounds the number of
+// finished items kept in memory whatever the order in which the producers finish them.
+template <typename T> class OrderedQueue {
+public:
+  explicit OrderedQueue(std::size_t capacity) : slots_(capacity) {}
+
+  void push(std::uint64_t index, T value) {
+    std::unique_lock lock{mutex_};
+    pushable_.wait(lock, [&] { return index < next_pop_ + slots_.size(); });
+    slots_[index % slots_.size()] = std::move(value);
+    lock.unlock();
+    poppable_.notify_one();
+  }
+
+  // Returns the item with the next index, waiting until it is pushed.
+  T pop() {
+    std::unique_lock lock{mutex_};
+    std::optional<T> &slot = slots_[next_pop_ % slots_.size()];
+    poppable_.wait(lock, [&] { return slot.has_value(); });
+    T value = std::move(*slot);
+    slot.reset();
+    ++next_pop_;
+    lock.unlock();
+    pushable_.notify_all();
+    return value;
+  }
+
+private:
+  std::mutex mutex_{};
+  std::condition_variable pushable_{};
+  std::condition_variable poppable_{};
+  std::vector<std::optional<T>> slots_;
+  std::uint64_t next_pop_ = 0;
+};
+
+} // namespace dataset_gen
+
+#endif // !DATASET_GEN_ORDERED_QUEUE_HPP
@@ -0,0 +1,222 @@
+#ifndef DATASET_GEN_RANDOM_HPP
+#define DATASET_GEN_RANDOM_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "Util.hpp"
+
+namespace dataset_gen {
+
+// RNG engines for the battle engine
+//
+// An engine is constructed from a 32-bit seed. next() returns a value in [0, max] and fill() writes the next n
+// values of the same sequence. Every engine is deterministic for a given seed.
+
+// The reference Lehmer generator, the one the datasets have always been generated with.
+struct LehmerRng {
+  static constexpr std::uint64_t max = random_max;
+
+  std::uint32_t state;
+
+  explicit LehmerRng(std::uint32_t seed) : state{seed} {}
+
+  std::uint32_t next() { return state = random_next(state); }
+
+  void fill(std::uint32_t *out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+      out[i] = next();
+  }
+};
+
+// The same sequence as LehmerRng, but the modulus 2^31 - 1 is a Mersenne prime, so the reduction needs only shifts and
+// adds instead of a 64-bit division.
+struct LehmerFastRng {
+  static constexpr std::uint64_t max = random_max;
+
+  std::uint32_t state;
+
+  explicit LehmerFastRng(std::uint32_t seed) : state{seed} {}
+
+  static constexpr std::uint32_t mul_mod(std::uint32_t x, std::uint64_t multiplier) {
+    std::uint64_t product = x * multiplier;
+    product = (product & random_modulus) + (product >> 31);
+    product = (product & random_modulus) + (product >> 31);
+    return static_cast<std::uint32_t>(product >= random_modulus ? product - random_modulus : product);
+  }
+
+  std::uint32_t next() { return state = mul_mod(state, random_multiplier); }
+
+  // Runs lanes independent steps of the sequence at once: lane i starts at the i-th next value and every lane jumps
+  // lanes values ahead per step, multiplying by multiplier^lanes. The loop over lanes vectorizes.
+  void fill(std::uint32_t *out, std::size_t n) {
+    constexpr std::size_t lanes = 16;
+    constexpr std::uint64_t jump = [] {
+      std::uint32_t m = 1;
+      for (std::size_t i = 0; i < lanes; ++i)
+        m = mul_mod(m, random_multiplier);
+      return m;
+    }();
+
+    const std::size_t vector_end = n / lanes * lanes;
+    if (vector_end != 0) {
+      std::array<std::uint32_t, lanes> x;
+      for (std::size_t lane = 0; lane < lanes; ++lane)
+        x[lane] = next();
+      for (std::size_t i = 0; i < vector_end; i += lanes) {
+        std::memcpy(out + i, x.data(), sizeof(x));
+        for (std::size_t lane = 0; lane < lanes; ++lane)
+          x[lane] = mul_mod(x[lane], jump);
+      }
+      state = out[vector_end - 1];
+    }
+    for (std::size_t i = vector_end; i < n; ++i)
+      out[i] = next();
+  }
+};
+
+// xoshiro128+ by David Blackman and Sebastiano Vigna, seeded with splitmix32.
+struct Xoshiro128PlusRng {
+  static constexpr std::uint64_t max = 0xffffffff;
+
+  std::uint32_t s[4];
+
+  explicit Xoshiro128PlusRng(std::uint32_t seed) {
+    for (auto &x : s) {
+      seed += 0x9e3779b9;
+      std::uint32_t z = seed;
+      z = (z ^ (z >> 16)) * 0x85ebca6b;
+      z = (z ^ (z >> 13)) * 0xc2b2ae35;
+      x = z ^ (z >> 16);
+    }
+  }
+
+  static constexpr std::uint32_t rotl(std::uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+  std::uint32_t next() {
+    const std::uint32_t result = s[0] + s[3];
+    const std::uint32_t t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 11);
+    return result;
+  }
+
+  void fill(std::uint32_t *out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+      out[i] = next();
+  }
+};
+
+// PCG32 (XSH RR 64/32) by Melissa O'Neill.
+struct Pcg32Rng {
+  static constexpr std::uint64_t max = 0xffffffff;
+  static constexpr std::uint64_t multiplier = 6364136223846793005u;
+  static constexpr std::uint64_t increment = 1442695040888963407u;
+
+  std::uint64_t state;
+
+  explicit Pcg32Rng(std::uint32_t seed) : state{0} {
+    next();
+    state += seed;
+    next();
+  }
+
+  std::uint32_t next() {
+    const std::uint64_t old = state;
+    state = old * multiplier + increment;
+    const auto xorshifted = static_cast<std::uint32_t>(((old >> 18) ^ old) >> 27);
+    const auto rot = static_cast<std::uint32_t>(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+  }
+
+  void fill(std::uint32_t *out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+      out[i] = next();
+  }
+};
+
+// Hands out the values of Rng from a buffer refilled in blocks with Rng::fill.
+template <typename Rng> struct BlockRng {
+  static constexpr std::uint64_t max = Rng::max;
+  static constexpr std::uint32_t block_size = 256;
+
+  Rng rng;
+  std::uint32_t pos = block_size;
+  alignas(vector_alignment) std::uint32_t block[block_size];
+
+  explicit BlockRng(std::uint32_t seed) : rng{seed} {}
+
+  std::uint32_t next() {
+    if (pos == block_size) {
+      rng.fill(block, block_size);
+      pos = 0;
+    }
+    return block[pos++];
+  }
+};
+
+// Whether Rng generates the same sequence as LehmerRng.
+template <typename Rng>
+constexpr bool is_lehmer_sequence = std::is_same_v<Rng, LehmerRng> || std::is_same_v<Rng, LehmerFastRng> ||
+                                    std::is_same_v<Rng, BlockRng<LehmerFastRng>>;
+
+enum class RngKind {
+  Lehmer,
+  LehmerFast,
+  LehmerBlock,
+  Xoshiro128Plus,
+  Pcg32,
+};
+
+constexpr const char *rng_kind_names[] = {"lehmer", "lehmer-fast", "lehmer-block", "xoshiro128+", "pcg32"};
+
+// Calls f(std::type_identity<Rng>{}) with the engine of the given kind.
+template <typename F> decltype(auto) with_rng(RngKind kind, F &&f) {
+  switch (kind) {
+  case RngKind::LehmerFast:
+    return f(std::type_identity<LehmerFastRng>{});
+  case RngKind::LehmerBlock:
+    return f(std::type_identity<BlockRng<LehmerFastRng>>{});
+  case RngKind::Xoshiro128Plus:
+    return f(std::type_identity<Xoshiro128PlusRng>{});
+  case RngKind::Pcg32:
+    return f(std::type_identity<Pcg32Rng>{});
+  case RngKind::Lehmer:
+    break;
+  }
+  return f(std::type_identity<LehmerRng>{});
+}
+
+// Dataset rows
+
+// Counter-based generator of the random numbers of one dataset row: the n-th value of row r is a hash of
+// (seed, r, n), so every row can be generated on its own, on any thread or host. It is splitmix64 started from a hash
+// of the seed and the row.
+class RowRng {
+public:
+  RowRng(std::uint32_t seed, std::uint64_t row) : state_{finalize(finalize(seed + golden_gamma) ^ row)} {}
+
+  std::uint32_t operator()() { return static_cast<std::uint32_t>(finalize(state_ += golden_gamma) >> 32); }
+
+private:
+  static constexpr std::uint64_t golden_gamma = 0x9e3779b97f4a7c15;
+
+  static constexpr std::uint64_t finalize(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  std::uint64_t state_;
+};
+
+} // namespace dataset_gen
+
+#endif // !DATASET_GEN_RANDOM_HPP
@@ -0,0 +1,45 @@
+#ifndef DATASET_GEN_RUNNING_STATS_HPP
+#define DATASET_GEN_RUNNING_STATS_HPP
+
+#include <cmath>
+#include <cstdint>
+
+#include "UnitGroups.hpp"
+#include "Units.hpp"
+
+namespace dataset_gen {
+
+// Streaming mean and standard deviation of unit groups (Welford's algorithm), updated one sample at a time.
+struct RunningStats {
+  std::uint32_t count{};
+  UnitGroups<double> mean{};
+  UnitGroups<double> m2{};
+
+  void add(const UnitGroups<std::uint32_t> &sample) {
+    ++count;
+    for (std::uint32_t kind = 0; kind < UnitKindEnd; ++kind) {
+      const double x = sample[kind];
+      const double delta = x - mean[kind];
+      mean[kind] += delta / count;
+      m2[kind] += delta * (x - mean[kind]);
+    }
+  }
+
+  // Sample standard deviation; needs at least two samples.
+  UnitGroups<double> sd() const { return sq_root(m2 / static_cast<double>(count - 1)); }
+
+  // Whether the standard error of each mean is at most rel_se times the mean.
+  bool converged(double rel_se) const {
+    for (std::uint32_t kind = 0; kind < UnitKindEnd; ++kind) {
+      const double variance = m2[kind] / static_cast<double>(count - 1);
+      const double max_se = rel_se * mean[kind];
+      if (variance / count > max_se * max_se)
+        return false;
+    }
+    return true;
+  }
+};
+
+} // namespace dataset_gen
+
+#endif // !DATASET_GEN_RUNNING_STATS_HPP
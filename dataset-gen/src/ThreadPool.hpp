@@ -0,0 +1,114 @@
+#ifndef DATASET_GEN_THREAD_POOL_HPP
+#define DATASET_GEN_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Topology.hpp"
+
+namespace dataset_gen {
+
+// Fixed set of threads running parallel loops. run(n, f) calls f(thread, i) for every i in [0, n), where thread is the
+// index in [0, num_threads()) of the thread making the call, and returns once all the calls are done. The calling
+// thread takes items too, as thread 0. Items are claimed one at a time from a shared counter, so uneven items still
+// keep all the threads busy. Concurrent calls of run() are serialized.
+class ThreadPool {
+public:
+  // With 0 threads, one per available CPU.
+  explicit ThreadPool(std::uint32_t num_threads) {
+    if (num_threads == 0)
+      num_threads = num_allowed_cpus();
+    threads_.reserve(num_threads - 1);
+    for (std::uint32_t thread = 1; thread < num_threads; ++thread)
+      threads_.emplace_back([this, thread] { work(thread); });
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock{mutex_};
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (auto &thread : threads_)
+      thread.join();
+  }
+
+  std::uint32_t num_threads() const { return static_cast<std::uint32_t>(threads_.size()) + 1; }
+
+  void run(std::size_t num_items, std::function<void(std::uint32_t, std::size_t)> job) {
+    std::lock_guard run_lock{run_mutex_};
+    {
+      std::lock_guard lock{mutex_};
+      job_ = std::move(job);
+      num_items_ = num_items;
+      next_item_.store(0, std::memory_order_relaxed);
+      num_busy_ = static_cast<std::uint32_t>(threads_.size());
+      ++generation_;
+    }
+    start_.notify_all();
+
+    run_items(0);
+
+    std::unique_lock lock{mutex_};
+    done_.wait(lock, [&] { return num_busy_ == 0; });
+    job_ = nullptr;
+  }
+
+private:
+  void run_items(std::uint32_t thread) {
+    for (;;) {
+      const std::size_t item = next_item_.fetch_add(1, std::memory_order_relaxed);
+      if (item >= num_items_)
+        break;
+      job_(thread, item);
+    }
+  }
+
+  void work(std::uint32_t thread) {
+    std::uint64_t generation = 0;
+    for (;;) {
+      {
+        std::unique_lock lock{mutex_};
+        start_.wait(lock, [&] { return stop_ || generation_ != generation; });
+        if (stop_)
+          return;
+        generation = generation_;
+      }
+
+      run_items(thread);
+
+      bool last;
+      {
+        std::lock_guard lock{mutex_};
+        last = --num_busy_ == 0;
+      }
+      if (last)
+        done_.notify_one();
+    }
+  }
+
+  std::mutex run_mutex_{};
+  std::mutex mutex_{};
+  std::condition_variable start_{};
+  std::condition_variable done_{};
+  std::vector<std::thread> threads_{};
+  std::function<void(std::uint32_t, std::size_t)> job_{};
+  std::size_t num_items_ = 0;
+  std::atomic<std::size_t> next_item_{};
+  std::uint64_t generation_ = 0;
+  std::uint32_t num_busy_ = 0;
+  bool stop_ = false;
+};
+
+} // namespace dataset_gen
+
+#endif // !DATASET_GEN_THREAD_POOL_HPP
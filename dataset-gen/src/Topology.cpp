@@ -0,0 +1,133 @@
+#include "Topology.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <sched.h>
+
+namespace dataset_gen {
+
+namespace {
+
+std::vector<std::uint32_t> allowed_cpus() {
+  std::vector<std::uint32_t> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (::sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (std::uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set))
+        cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// Parses a sysfs CPU list such as "0-3,8-11".
+std::vector<std::uint32_t> parse_cpu_list(const std::string &list) {
+  std::vector<std::uint32_t> cpus;
+  const char *p = list.c_str();
+  while (*p >= '0' && *p <= '9') {
+    char *end = nullptr;
+    const auto first = static_cast<std::uint32_t>(std::strtoul(p, &end, 10));
+    auto last = first;
+    if (*end == '-')
+      last = static_cast<std::uint32_t>(std::strtoul(end + 1, &end, 10));
+    for (std::uint32_t cpu = first; cpu <= last; ++cpu)
+      cpus.push_back(cpu);
+    p = *end == ',' ? end + 1 : end;
+  }
+  return cpus;
+}
+
+} // namespace
+
+std::vector<NumaNode> numa_nodes() {
+  const std::vector<std::uint32_t> allowed = allowed_cpus();
+  std::vector<NumaNode> nodes;
+
+  const char *const node_dir = "/sys/devices/system/node";
+  if (DIR *dir = ::opendir(node_dir)) {
+    while (const dirent *entry = ::readdir(dir)) {
+      if (std::strncmp(entry->d_name, "node", 4) != 0 || !(entry->d_name[4] >= '0' && entry->d_name[4] <= '9'))
+        continue;
+
+      std::ifstream in{std::string{node_dir} + '/' + entry->d_name + "/cpulist"};
+      std::string list;
+      std::getline(in, list);
+      NumaNode node{.id = static_cast<std::uint32_t>(std::strtoul(entry->d_name + 4, nullptr, 10)), .cpus = {}};
+      for (std::uint32_t cpu : parse_cpu_list(list)) {
+        if (std::ranges::binary_search(allowed, cpu))
+          node.cpus.push_back(cpu);
+      }
+      if (!node.cpus.empty())
+        nodes.push_back(std::move(node));
+    }
+    ::closedir(dir);
+  }
+
+  if (nodes.empty())
+    nodes.push_back({.id = 0, .cpus = allowed});
+  std::ranges::sort(nodes, {}, &NumaNode::id);
+  return nodes;
+}
+
+ThreadPlacement::ThreadPlacement(Affinity affinity, std::uint32_t num_threads)
+    : affinity_{affinity}, nodes_{numa_nodes()} {
+  std::uint64_t num_cpus = 0;
+  for (const NumaNode &node : nodes_)
+    num_cpus += node.cpus.size();
+
+  // Every node gets its share of the threads rounded down, and the threads left go to the nodes with the largest
+  // remainders. Without any allowed CPU, all of them go to the first node.
+  std::vector<std::uint32_t> node_threads(nodes_.size());
+  if (num_cpus == 0) {
+    node_threads[0] = num_threads;
+  } else {
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> remainders;
+    std::uint32_t num_placed = 0;
+    for (std::uint32_t i = 0; i < nodes_.size(); ++i) {
+      const std::uint64_t share = std::uint64_t{num_threads} * nodes_[i].cpus.size();
+      node_threads[i] = static_cast<std::uint32_t>(share / num_cpus);
+      num_placed += node_threads[i];
+      remainders.emplace_back(share % num_cpus, i);
+    }
+    std::ranges::stable_sort(remainders, std::ranges::greater{}, &std::pair<std::uint64_t, std::uint32_t>::first);
+    for (std::uint32_t i = 0; num_placed < num_threads; ++i, ++num_placed)
+      ++node_threads[remainders[i].second];
+  }
+
+  for (std::uint32_t i = 0; i < nodes_.size(); ++i) {
+    const std::vector<std::uint32_t> &cpus = nodes_[i].cpus;
+    for (std::uint32_t index_in_node = 0; index_in_node < node_threads[i]; ++index_in_node) {
+      thread_nodes_.push_back(i);
+      thread_cpus_.push_back(cpus.empty() ? 0 : cpus[index_in_node % cpus.size()]);
+    }
+  }
+}
+
+bool ThreadPlacement::apply(std::uint32_t thread) const {
+  const NumaNode &node = nodes_[node_index(thread)];
+  if (affinity_ == Affinity::None || node.cpus.empty())
+    return affinity_ == Affinity::None;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (affinity_ == Affinity::Cpu) {
+    CPU_SET(thread_cpus_[thread], &set);
+  } else {
+    for (std::uint32_t cpu : node.cpus)
+      CPU_SET(cpu, &set);
+  }
+  // On Linux, pid 0 is the calling thread, not the whole process.
+  return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+} // namespace dataset_gen
@@ -0,0 +1,74 @@
+#ifndef DATASET_GEN_TOPOLOGY_HPP
+#define DATASET_GEN_TOPOLOGY_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <sched.h>
+
+namespace dataset_gen {
+
+// NUMA topology and thread placement
+//
+// The nodes are read from /sys/devices/system/node, so no libnuma is needed. Memory is allocated on the node of the
+// thread that first touches it, so a pinned thread that allocates its own buffers gets them on its node.
+
+struct NumaNode {
+  std::uint32_t id;
+  // The CPUs of the node this process is allowed to run on.
+  std::vector<std::uint32_t> cpus;
+};
+
+// Number of CPUs this process is allowed to run on, which may be fewer than std::thread::hardware_concurrency() in a
+// container or under taskset; at least 1.
+inline std::uint32_t num_allowed_cpus() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (::sched_getaffinity(0, sizeof(set), &set) != 0 || CPU_COUNT(&set) == 0)
+    return 1;
+  return static_cast<std::uint32_t>(CPU_COUNT(&set));
+}
+
+// Returns the nodes with CPUs this process is allowed to run on. Without a NUMA topology in sysfs, returns a single
+// node 0 with all the allowed CPUs.
+std::vector<NumaNode> numa_nodes();
+
+enum class Affinity {
+  // Threads run wherever the scheduler puts them.
+  None,
+  // Every thread is pinned to one CPU.
+  Cpu,
+  // Every thread is bound to the CPUs of one node and moves freely within it.
+  Node,
+};
+
+inline constexpr const char *affinity_names[] = {"none", "cpu", "node"};
+
+// Places threads 0, 1, ..., num_threads - 1 over the nodes in proportion to their CPUs, the first threads on the first
+// node, and within a node over its CPUs in order, so that no two threads share a CPU unless there are more threads
+// than CPUs.
+class ThreadPlacement {
+public:
+  ThreadPlacement(Affinity affinity, std::uint32_t num_threads);
+
+  Affinity affinity() const { return affinity_; }
+  const std::vector<NumaNode> &nodes() const { return nodes_; }
+
+  // Index in nodes() of the node of the thread.
+  std::uint32_t node_index(std::uint32_t thread) const { return thread_nodes_[thread]; }
+
+  // Binds the calling thread to the CPUs of the thread; does nothing with Affinity::None. Call it before the thread
+  // allocates its buffers. Returns false if the affinity cannot be set.
+  bool apply(std::uint32_t thread) const;
+
+private:
+  Affinity affinity_;
+  std::vector<NumaNode> nodes_;
+  std::vector<std::uint32_t> thread_nodes_;
+  // CPU of every thread with Affinity::Cpu.
+  std::vector<std::uint32_t> thread_cpus_;
+};
+
+} // namespace dataset_gen
+
+#endif // !DATASET_GEN_TOPOLOGY_HPP
@@ -56,6 +56,9 @@ struct UnitAttrs {
 
 extern const UnitAttrs unit_attrs[UnitKindEnd];
 
+// The ships, the kinds before the defenses: the only ones with attributes so far.
+constexpr std::uint32_t num_ship_kinds = Battlecruiser + 1;
+
 } // namespace dataset_gen
 
 #endif // !DATASET_GEN_UNITS_HPP
@@ -1,7 +1,22 @@
 #ifndef DATASET_GEN_UTIL_HPP
 #define DATASET_GEN_UTIL_HPP
 
+#include <cstddef>
 #include <cstdint>
+#include <new>
+#include <vector>
+
+// GCC 12 and older warn that the _mm512_undefined_*() vectors of their own intrinsic headers are used uninitialized
+// when AVX-512 intrinsics are inlined (GCC bug 105593, fixed in GCC 13). Code with such intrinsics goes between these.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 13
+#define DATASET_GEN_AVX512_BEGIN                                                                                       \
+  _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Wuninitialized\"")                                \
+      _Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+#define DATASET_GEN_AVX512_END _Pragma("GCC diagnostic pop")
+#else
+#define DATASET_GEN_AVX512_BEGIN
+#define DATASET_GEN_AVX512_END
+#endif
 
 namespace dataset_gen {
 
@@ -16,6 +31,27 @@ constexpr std::uint32_t random_next(std::uint32_t r) {
   return static_cast<std::uint32_t>(static_cast<std::uint64_t>(r) * random_multiplier % random_modulus);
 }
 
+// Allocator for vectors whose data must be aligned for vector loads, e.g. AlignedVector<float>.
+
+constexpr std::size_t vector_alignment = 64;
+
+template <typename T> struct AlignedAllocator {
+  using value_type = T;
+
+  AlignedAllocator() = default;
+  template <typename U> constexpr AlignedAllocator(const AlignedAllocator<U> &) noexcept {}
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{vector_alignment}));
+  }
+
+  void deallocate(T *ptr, std::size_t /*n*/) noexcept { ::operator delete(ptr, std::align_val_t{vector_alignment}); }
+
+  template <typename U> bool operator==(const AlignedAllocator<U> &) const noexcept { return true; }
+};
+
+template <typename T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
 } // namespace dataset_gen
 
 #endif // !DATASET_GEN_UTIL_HPP
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+
+from typing import Dict, List, Optional, Sequence
+
+import numpy as np
+import pandas as pd
+
+# Keep in sync with dataset-gen/src/DatasetWriter.hpp
+BINARY_MAGIC = b'OGNNDSET'
+BINARY_VERSION = 3
+
+HEADER_DTYPE = np.dtype([
+    ('magic', 'S8'),
+    ('version', '<u4'),
+    ('header_size', '<u4'),
+    ('num_rows', '<u8'),
+    ('num_columns', '<u4'),
+    ('num_unit_kinds', '<u4'),
+    ('alignment', '<u4'),
+    ('seed', '<u4'),
+    ('first_row', '<u8'),
+    ('dataset_size', '<u8'),
+    ('options_size', '<u4'),
+    ('reserved', '<u4'),
+])
+COLUMN_DTYPE = np.dtype([
+    ('name', 'S40'),
+    ('type', '<u4'),
+    ('elem_size', '<u4'),
+    ('offset', '<u8'),
+    ('reserved', '<u8'),
+])
+UNIT_KIND_DTYPE = np.dtype([('name', 'S32')])
+# Optional columns that dataset-gen appends after the outputs, in this order, each only with the options that add it:
+# num_replicas with --rel-se and --smooth-max above --smooth-min, and weight with --sampler weighted.
+# Binary datasets name their columns; CSV datasets do not, so their readers must be told which ones they have.
+EXTRA_COLUMNS = ['num_replicas', 'weight']
+COLUMN_TYPES = {
+    1: np.uint8,
+    2: np.float32,
+    3: np.uint32,
+}
+
+
+def is_binary(path: str) -> bool:
+    with open(path, 'rb') as f:
+        return f.read(len(BINARY_MAGIC)) == BINARY_MAGIC
+
+
+class BinaryDataset:
+    """Memory-mapped view of a dataset written by `dataset-gen --format binary`."""
+
+    def __init__(self, path: str):
+        header = np.fromfile(path, dtype=HEADER_DTYPE, count=1)[0]
+        if header['magic'] != BINARY_MAGIC:
+            raise ValueError('{} is not a binary dataset'.format(path))
+        # Version 2 only adds the seed and the row range to the header, and version 3 the options.
+        if header['version'] not in (1, 2, BINARY_VERSION):
+            raise ValueError('Unsupported dataset version {}'.format(header['version']))
+
+        self.num_rows = int(header['num_rows'])
+        self.first_row = int(header['first_row'])
+        self.dataset_size = int(header['dataset_size'])
+        self.seed = int(header['seed'])
+        num_columns = int(header['num_columns'])
+        columns = np.fromfile(path, dtype=COLUMN_DTYPE, count=num_columns, offset=HEADER_DTYPE.itemsize)
+        kinds_offset = HEADER_DTYPE.itemsize + num_columns * COLUMN_DTYPE.itemsize
+        kinds = np.fromfile(path, dtype=UNIT_KIND_DTYPE, count=int(header['num_unit_kinds']), offset=kinds_offset)
+
+        self.unit_kinds: List[str] = [k.decode() for k in kinds['name']]
+        # The options of dataset-gen that change the rows, other than the seed, as "name value" lines.
+        options_offset = kinds_offset + len(kinds) * UNIT_KIND_DTYPE.itemsize
+        with open(path, 'rb') as f:
+            f.seek(options_offset)
+            self.options: str = f.read(int(header['options_size'])).decode()
+        self.columns: Dict[str, np.ndarray] = {}
+        for column in columns:
+            dtype = COLUMN_TYPES[int(column['type'])]
+            self.columns[column['name'].decode()] = np.memmap(path, dtype=dtype, mode='r', offset=int(column['offset']),
+                                                              shape=(self.num_rows,))
+
+    def to_numpy(self, dtype=np.float32) -> np.ndarray:
+        out = np.empty((self.num_rows, len(self.columns)), dtype=dtype)
+        for i, values in enumerate(self.columns.values()):
+            out[:, i] = values
+        return out
+
+    def to_dataframe(self) -> pd.DataFrame:
+        return pd.DataFrame(self.to_numpy())
+
+
+def load_dataset(path: str) -> pd.DataFrame:
+    """Loads a dataset in either format; columns are positional, as with `pd.read_csv(path, header=None)`."""
+    if is_binary(path):
+        return BinaryDataset(path).to_dataframe()
+    return pd.read_csv(path, header=None)
+
+
+def load_extra_column(path: str, df: pd.DataFrame, name: str,
+                      csv_extra_columns: Sequence[str] = ()) -> Optional[np.ndarray]:
+    """Values of the optional column name of the dataset at path, loaded as df by load_dataset(), or None if it does
+    not have it. Binary datasets are looked up by column name. CSV ones by position: csv_extra_columns lists the
+    optional columns they have, in the order of EXTRA_COLUMNS."""
+    if is_binary(path):
+        column = BinaryDataset(path).columns.get(name)
+        return None if column is None else np.asarray(column)
+    if list(csv_extra_columns) != [c for c in EXTRA_COLUMNS if c in csv_extra_columns]:
+        raise ValueError('CSV extra columns must be some of {}, in that order'.format(', '.join(EXTRA_COLUMNS)))
+    if name not in csv_extra_columns:
+        return None
+    return df.iloc[:, list(csv_extra_columns).index(name) - len(csv_extra_columns)].to_numpy()
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+
+import argparse
+from typing import Tuple
+
+import numpy as np
+import pandas as pd
+
+from dataset import load_dataset
+
+NUM_TECHS = 3
+NUM_UNIT_KINDS = 14
+
+INPUT_SIZE = 2 * (NUM_TECHS + NUM_UNIT_KINDS)
+OUTPUT_SIZE = 2 * (2 * NUM_UNIT_KINDS)
+
+# Keep in sync with scenario_region() in dataset-gen/src/DatasetGen.cpp
+ERROR_MAP_HEADER = 'dataset-gen-error-map 1'
+MAX_TECH_GAP = 30
+TECH_GAP_WIDTH = 5
+
+
+def load_scales(path: str) -> Tuple[float, float, float, float]:
+    with open(path) as f:
+        tech_scale, ships_scale, mean_scale, sd_scale = map(float, f.read().strip().split())
+    return tech_scale, ships_scale, mean_scale, sd_scale
+
+
+def scenario_regions(inputs: np.ndarray) -> pd.DataFrame:
+    """Bins the battles by the bit width of their total number of ships, the kind with the most ships of each side
+    (the first on ties, NUM_UNIT_KINDS without ships) and the tech gap between the sides."""
+    techs = [inputs[:, side * NUM_TECHS:(side + 1) * NUM_TECHS] for side in range(2)]
+    units = [inputs[:, 2 * NUM_TECHS + side * NUM_UNIT_KINDS:2 * NUM_TECHS + (side + 1) * NUM_UNIT_KINDS]
+             for side in range(2)]
+
+    num_ships = (units[0].sum(axis=1) + units[1].sum(axis=1)).astype(np.float64)
+    # The exponent of frexp() is the bit width of an integer, 0 for 0.
+    strength = np.frexp(num_ships)[1]
+    main_kinds = [np.where(u.sum(axis=1) > 0, np.argmax(u, axis=1), NUM_UNIT_KINDS) for u in units]
+    tech_gap = np.clip(techs[0].sum(axis=1) - techs[1].sum(axis=1), -MAX_TECH_GAP, MAX_TECH_GAP).astype(np.int64)
+
+    return pd.DataFrame({
+        'strength': strength,
+        'attacker_kind': main_kinds[0],
+        'defender_kind': main_kinds[1],
+        'tech_gap': (tech_gap + MAX_TECH_GAP) // TECH_GAP_WIDTH,
+    })
+
+
+def row_errors(df: pd.DataFrame, model_path: str, scales: Tuple[float, float, float, float]) -> np.ndarray:
+    """Mean squared error of the model on every row, on the normalized outputs it is trained on."""
+    from tensorflow.keras.models import load_model
+
+    tech_scale, ships_scale, mean_scale, sd_scale = scales
+    inputs = df.iloc[:, :INPUT_SIZE].to_numpy(dtype=np.float32)
+    outputs = df.iloc[:, INPUT_SIZE:(INPUT_SIZE + OUTPUT_SIZE)].to_numpy(dtype=np.float32)
+    inputs[:, :2 * NUM_TECHS] *= tech_scale
+    inputs[:, 2 * NUM_TECHS:] *= ships_scale
+    outputs[:, :2 * NUM_UNIT_KINDS] *= mean_scale
+    outputs[:, 2 * NUM_UNIT_KINDS:] *= sd_scale
+
+    predictions = load_model(model_path).predict(inputs)
+    return np.mean((predictions - outputs) ** 2, axis=1)
+
+
+def write_error_map(path: str, inputs: np.ndarray, errors: np.ndarray):
+    regions = scenario_regions(inputs)
+    regions['error'] = errors
+    grouped = regions.groupby(['strength', 'attacker_kind', 'defender_kind', 'tech_gap'])['error']
+    with open(path, 'w') as f:
+        f.write(ERROR_MAP_HEADER + '\n')
+        for (strength, attacker_kind, defender_kind, tech_gap), rows, error in zip(grouped.size().index,
+                                                                                  grouped.size(), grouped.mean()):
+            f.write('{} {} {} {} {} {:.9g}\n'.format(strength, attacker_kind, defender_kind, tech_gap, rows, error))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Writes the error of the model per region of battles, for dataset-gen --sampler weighted.')
+    parser.add_argument('--model', default='model', help='Keras model directory (default: model)')
+    parser.add_argument('--scales', default='scales', help='Scales file (default: scales)')
+    parser.add_argument('--dataset', default='dataset',
+                        help='Dataset to measure the error on, drawn with the uniform sampler (default: dataset)')
+    parser.add_argument('--out', default='error-map', help='Output file (default: error-map)')
+    args = parser.parse_args()
+
+    df = load_dataset(args.dataset)
+    errors = row_errors(df, args.model, load_scales(args.scales))
+    write_error_map(args.out, df.iloc[:, :INPUT_SIZE].to_numpy(), errors)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+
+import argparse
+from typing import List, Tuple
+
+import numpy as np
+
+# Keep in sync with dataset-gen/src/NnModel.hpp
+MODEL_MAGIC = b'OGNNMODL'
+MODEL_VERSION = 1
+MODEL_ALIGNMENT = 64
+PANEL_WIDTH = 16
+ACTIVATIONS = {'linear': 0, 'relu': 1}
+
+HEADER_DTYPE = np.dtype([
+    ('magic', 'S8'),
+    ('version', '<u4'),
+    ('header_size', '<u4'),
+    ('num_layers', '<u4'),
+    ('num_techs', '<u4'),
+    ('num_unit_kinds', '<u4'),
+    ('alignment', '<u4'),
+    ('tech_scale', '<f8'),
+    ('ships_scale', '<f8'),
+    ('mean_scale', '<f8'),
+    ('sd_scale', '<f8'),
+])
+LAYER_DTYPE = np.dtype([
+    ('num_inputs', '<u4'),
+    ('num_outputs', '<u4'),
+    ('activation', '<u4'),
+    ('reserved', '<u4'),
+    ('weights_offset', '<u8'),
+    ('biases_offset', '<u8'),
+])
+
+# Kernel of shape (num_inputs, num_outputs) as in Keras, biases and the name of the activation
+Layer = Tuple[np.ndarray, np.ndarray, str]
+
+
+def align_up(value: int) -> int:
+    return (value + MODEL_ALIGNMENT - 1) // MODEL_ALIGNMENT * MODEL_ALIGNMENT
+
+
+def num_panels(num_outputs: int) -> int:
+    return (num_outputs + PANEL_WIDTH - 1) // PANEL_WIDTH
+
+
+def pack_kernel(kernel: np.ndarray) -> np.ndarray:
+    """Splits the kernel into panels of PANEL_WIDTH outputs, (num_panels, num_inputs, PANEL_WIDTH), zero padded."""
+    num_inputs, num_outputs = kernel.shape
+    padded = np.zeros((num_inputs, num_panels(num_outputs) * PANEL_WIDTH), dtype='<f4')
+    padded[:, :num_outputs] = kernel
+    return np.ascontiguousarray(padded.reshape(num_inputs, -1, PANEL_WIDTH).transpose(1, 0, 2))
+
+
+def pack_biases(biases: np.ndarray) -> np.ndarray:
+    padded = np.zeros(num_panels(len(biases)) * PANEL_WIDTH, dtype='<f4')
+    padded[:len(biases)] = biases
+    return padded
+
+
+def write_model(path: str, layers: List[Layer], scales: Tuple[float, float, float, float]):
+    num_outputs = layers[-1][0].shape[1]
+    num_inputs = layers[0][0].shape[0]
+    assert num_outputs % 4 == 0
+    num_unit_kinds = num_outputs // 4
+    num_techs = num_inputs // 2 - num_unit_kinds
+
+    header = np.zeros(1, dtype=HEADER_DTYPE)
+    header['magic'] = MODEL_MAGIC
+    header['version'] = MODEL_VERSION
+    header['header_size'] = align_up(HEADER_DTYPE.itemsize + len(layers) * LAYER_DTYPE.itemsize)
+    header['num_layers'] = len(layers)
+    header['num_techs'] = num_techs
+    header['num_unit_kinds'] = num_unit_kinds
+    header['alignment'] = MODEL_ALIGNMENT
+    header['tech_scale'], header['ships_scale'], header['mean_scale'], header['sd_scale'] = scales
+
+    descs = np.zeros(len(layers), dtype=LAYER_DTYPE)
+    blocks = []
+    offset = int(header['header_size'][0])
+    for desc, (kernel, biases, activation) in zip(descs, layers):
+        weights = pack_kernel(kernel)
+        padded_biases = pack_biases(biases)
+        desc['num_inputs'], desc['num_outputs'] = kernel.shape
+        desc['activation'] = ACTIVATIONS[activation]
+        desc['weights_offset'] = offset
+        offset = align_up(offset + weights.nbytes)
+        desc['biases_offset'] = offset
+        offset = align_up(offset + padded_biases.nbytes)
+        blocks += [weights, padded_biases]
+
+    with open(path, 'wb') as f:
+        f.write(header.tobytes())
+        f.write(descs.tobytes())
+        for block in blocks:
+            f.write(b'\0' * (align_up(f.tell()) - f.tell()))
+            f.write(block.tobytes())
+
+
+def load_scales(path: str) -> Tuple[float, float, float, float]:
+    with open(path) as f:
+        tech_scale, ships_scale, mean_scale, sd_scale = map(float, f.read().strip().split())
+    return tech_scale, ships_scale, mean_scale, sd_scale
+
+
+def load_layers(model_path: str) -> List[Layer]:
+    from tensorflow.keras.models import load_model
+
+    layers = []
+    for layer in load_model(model_path).layers:
+        kernel, biases = layer.get_weights()
+        layers.append((kernel, biases, layer.get_config()['activation']))
+    return layers
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Exports the model and the scales saved by train.py for nn-infer.')
+    parser.add_argument('--model', default='model', help='Keras model directory (default: model)')
+    parser.add_argument('--scales', default='scales', help='Scales file (default: scales)')
+    parser.add_argument('--out', default='model.bin', help='Output file (default: model.bin)')
+    args = parser.parse_args()
+
+    write_model(args.out, load_layers(args.model), load_scales(args.scales))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+
+import ctypes
+import os
+from typing import Optional, Tuple
+
+import numpy as np
+
+# Keep in sync with dataset-gen/src/NnInferApi.h
+API_VERSION = 1
+NUM_TECHS = 3
+FLOAT32 = 0
+INT8 = 1
+DEFAULT_LIBRARY_PATH = 'build/libnn-infer.so'
+
+
+class NnInfer:
+    """Predictions of a model exported by export-model.py, through the C API of libnn-infer.
+
+    Set NN_INFER_LIBRARY or pass library_path to load the library from another path than build/."""
+
+    def __init__(self, model_path: str = 'model.bin', int8: bool = False, library_path: Optional[str] = None,
+                 num_threads: int = 0):
+        # Set first, so that __del__ works even if loading the library fails.
+        self._nn = None
+        path = library_path or os.environ.get('NN_INFER_LIBRARY', DEFAULT_LIBRARY_PATH)
+        self._lib = ctypes.CDLL(path)
+        self._lib.nn_infer_api_version.restype = ctypes.c_uint32
+        self._lib.nn_infer_create.argtypes = [
+            ctypes.c_char_p, ctypes.c_uint32, ctypes.c_uint32, ctypes.POINTER(ctypes.c_char_p),
+        ]
+        self._lib.nn_infer_create.restype = ctypes.c_void_p
+        self._lib.nn_infer_destroy.argtypes = [ctypes.c_void_p]
+        self._lib.nn_infer_num_unit_kinds.argtypes = [ctypes.c_void_p]
+        self._lib.nn_infer_num_unit_kinds.restype = ctypes.c_uint32
+        self._lib.nn_infer_predict.argtypes = [
+            ctypes.c_void_p, ctypes.c_size_t,
+            ctypes.c_void_p, ctypes.c_void_p,
+            ctypes.c_void_p, ctypes.c_void_p,
+        ]
+        self._lib.nn_infer_predict.restype = ctypes.c_int
+
+        version = self._lib.nn_infer_api_version()
+        if version != API_VERSION:
+            raise RuntimeError('Unsupported nn-infer API version {}'.format(version))
+
+        error = ctypes.c_char_p()
+        self._nn = self._lib.nn_infer_create(model_path.encode(), INT8 if int8 else FLOAT32, num_threads,
+                                             ctypes.byref(error))
+        if self._nn is None:
+            raise RuntimeError('Failed to load model {}: {}'.format(model_path, error.value.decode()))
+        self.num_unit_kinds: int = self._lib.nn_infer_num_unit_kinds(self._nn)
+
+    def close(self):
+        if self._nn is not None:
+            self._lib.nn_infer_destroy(self._nn)
+            self._nn = None
+
+    def __del__(self):
+        self.close()
+
+    def predict(self, techs: np.ndarray, units: np.ndarray) -> Tuple[np.ndarray, np.ndarray]:
+        """Predicts the means and the standard deviations of the units left, with the shape of units.
+
+        techs has shape (num_battles, 2, 3) and units (num_battles, 2, num_unit_kinds). The unit kinds are those of the
+        model: for a model trained by train.py, the ships, the same kinds in the same order as BattleEngine.unit_kinds,
+        so the techs and units passed to BattleEngine.fight() can be passed as they are. The results are float32."""
+        techs = np.ascontiguousarray(techs, dtype=np.uint8)
+        units = np.ascontiguousarray(units, dtype=np.uint32)
+        num_battles = units.shape[0]
+        if techs.shape != (num_battles, 2, NUM_TECHS) or units.shape != (num_battles, 2, self.num_unit_kinds):
+            raise ValueError('techs must have shape (n, 2, {}) and units (n, 2, {})'.format(
+                NUM_TECHS, self.num_unit_kinds))
+
+        means = np.empty(units.shape, dtype=np.float32)
+        sds = np.empty(units.shape, dtype=np.float32)
+        status = self._lib.nn_infer_predict(self._nn, num_battles, techs.ctypes.data, units.ctypes.data,
+                                            means.ctypes.data, sds.ctypes.data)
+        if status != 0:
+            raise ValueError('nn_infer_predict failed with status {}'.format(status))
+        return means, sds
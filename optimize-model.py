@@ -1,5 +1,8 @@
 #!/usr/bin/env python3
 
+from typing import Optional
+
+import numpy as np
 import pandas as pd
 from tensorflow.keras.callbacks import TensorBoard
 
@@ -9,7 +12,7 @@ NUM_LAYERS = range(2, 7)
 NUM_UNITS = [32, 64, 128, 256, 512, 1024, 2048]
 
 
-def optimize(df: pd.DataFrame):
+def optimize(df: pd.DataFrame, weights: Optional[np.ndarray]):
     X, Y = df.iloc[:, :INPUT_SIZE], df.iloc[:, INPUT_SIZE:]
 
     for num_layers in NUM_LAYERS:
@@ -18,13 +21,13 @@ def optimize(df: pd.DataFrame):
             print(name)
             tb = TensorBoard(log_dir='logs/{}'.format(name))
             model = create_model(num_layers, num_units)
-            model.fit(X, Y, epochs=20, validation_split=0.1, callbacks=[tb])
+            model.fit(X, Y, sample_weight=weights, epochs=20, validation_split=0.1, callbacks=[tb])
 
 
 def main():
-    df = load_data('dataset')
+    df, weights = load_data('dataset')
     _scales = normalize(df)
-    optimize(df)
+    optimize(df, weights)
 
 
 if __name__ == '__main__':
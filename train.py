@@ -1,9 +1,15 @@
 #!/usr/bin/env python3
 
+import argparse
+from typing import Optional, Sequence, Tuple
+
+import numpy as np
 import pandas as pd
 from tensorflow.keras import Model, Sequential
 from tensorflow.keras.layers import Dense
 
+from dataset import EXTRA_COLUMNS, is_binary, load_dataset, load_extra_column
+
 NUM_TECHS = 3
 NUM_UNIT_KINDS = 14
 
@@ -13,11 +19,22 @@ INPUT_SIZE = 2 * (NUM_TECHS + NUM_UNIT_KINDS)
 OUTPUT_SIZE = 2 * (2 * NUM_UNIT_KINDS)
 
 
-def load_data(dataset_path: str) -> pd.DataFrame:
-    df = pd.read_csv(dataset_path, header=None)
+def load_data(dataset_path: str, csv_extra_columns: Sequence[str] = ()) -> Tuple[pd.DataFrame, Optional[np.ndarray]]:
+    """Returns the inputs and outputs of the rows, and their sample weights if the dataset has a weight column
+    (dataset-gen --sampler weighted), scaled to a mean of 1. See EXTRA_COLUMNS for csv_extra_columns."""
+    df = load_dataset(dataset_path)
     _, num_cols = df.shape
-    assert num_cols == INPUT_SIZE + OUTPUT_SIZE
-    return df
+    # Optional columns (e.g. num_replicas) follow the inputs and outputs
+    if is_binary(dataset_path):
+        assert num_cols >= INPUT_SIZE + OUTPUT_SIZE
+    else:
+        assert num_cols == INPUT_SIZE + OUTPUT_SIZE + len(csv_extra_columns), \
+            'the CSV dataset has {} columns, expected {} with --csv-extra-columns'.format(
+                num_cols, INPUT_SIZE + OUTPUT_SIZE + len(csv_extra_columns))
+    weights = load_extra_column(dataset_path, df, 'weight', csv_extra_columns)
+    if weights is not None:
+        weights = weights.astype(np.float64) / weights.mean()
+    return df.iloc[:, :(INPUT_SIZE + OUTPUT_SIZE)].copy(), weights
 
 
 def normalize(df: pd.DataFrame) -> (float, float, float, float):
@@ -50,16 +67,24 @@ def create_model(num_layers: int, num_units: int) -> Sequential:
     return model
 
 
-def train(df: pd.DataFrame, model: Model, num_epochs: int):
+def train(df: pd.DataFrame, weights: Optional[np.ndarray], model: Model, num_epochs: int):
     X, Y = df.iloc[:, :INPUT_SIZE], df.iloc[:, INPUT_SIZE:]
-    model.fit(X, Y, epochs=num_epochs, validation_split=0.1)
+    model.fit(X, Y, sample_weight=weights, epochs=num_epochs, validation_split=0.1)
 
 
 def main():
-    df = load_data('dataset')
+    parser = argparse.ArgumentParser(description='Trains the model on a dataset of dataset-gen.')
+    parser.add_argument('--dataset', default='dataset', help='Dataset, CSV or binary (default: dataset)')
+    parser.add_argument('--csv-extra-columns', default='',
+                        help='Comma-separated optional columns of a CSV dataset, among and in the order of {}, '
+                             'as the options of dataset-gen add them; binary datasets name their columns'.format(
+                                 ', '.join(EXTRA_COLUMNS)))
+    args = parser.parse_args()
+
+    df, weights = load_data(args.dataset, [c for c in args.csv_extra_columns.split(',') if c])
     scales = normalize(df)
     model = create_model(num_layers=4, num_units=1024)
-    train(df, model, num_epochs=20)
+    train(df, weights, model, num_epochs=20)
     model.save('model')
     with open('scales', 'w') as f:
         f.write(' '.join(map(str, scales)))